@@ -2,3 +2,7 @@
 #define STATE_ACCESS_DELAY_MS 10
 #define BUFFSZ 1024
 //#define MAX_PROC 0 // Numero de processos filhos ativos em paralelo
+#define MAX_JOB_FILES 1024  // Numero maximo de ficheiros .jobs numa diretoria
+#define MAX_JOB_FILE_NAME 256
+#define WRITER_BUFFER_SIZE 65536  // Tamanho dos blocos escritos nos ficheiros .out
+#define PREFETCH_SLOTS 16  // Eventos que podem estar a ser pre-carregados ao mesmo tempo
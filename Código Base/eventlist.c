@@ -5,6 +5,10 @@
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
+  if (pthread_rwlock_init(&list->rwl, NULL) != 0) {
+    free(list);
+    return NULL;
+  }
   list->head = NULL;
   list->tail = NULL;
   return list;
@@ -33,6 +37,7 @@ int append_to_list(struct EventList* list, struct Event* event) {
 static void free_event(struct Event* event) {
   if (!event) return;
 
+  pthread_mutex_destroy(&event->mutex);
   free(event->data);
   free(event);
 }
@@ -49,6 +54,7 @@ void free_list(struct EventList* list) {
     free(temp);
   }
 
+  pthread_rwlock_destroy(&list->rwl);
   free(list);
 }
 
@@ -1,6 +1,7 @@
 #ifndef EVENT_LIST_H
 #define EVENT_LIST_H
 
+#include <pthread.h>
 #include <stddef.h>
 
 struct Event {
@@ -10,7 +11,8 @@ struct Event {
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;  /// Array of size rows * cols with the reservations for each seat.
+  unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
+  pthread_mutex_t mutex;  // Mutex to protect the event
 };
 
 struct ListNode {
@@ -22,6 +24,7 @@ struct ListNode {
 struct EventList {
   struct ListNode* head;  // Head of the list
   struct ListNode* tail;  // Tail of the list
+  pthread_rwlock_t rwl;   // Lock to protect the list
 };
 
 /// Creates a new event list.
@@ -0,0 +1,423 @@
+#include "jobs.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "operations.h"
+
+/// Reusable barrier where the threads of a job meet at each BARRIER.
+/// @note Implemented with a mutex and a condition variable, since pthread_barrier_t is not available on MacOS.
+struct JobBarrier {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned int count;       /// Number of threads that take part in the barrier.
+  unsigned int waiting;     /// Number of threads waiting in the current round.
+  unsigned long generation; /// Incremented every time the barrier opens.
+};
+
+/// Paces the commands of every job to a maximum rate.
+struct JobPacer {
+  pthread_mutex_t mutex;
+  unsigned int ops_per_sec;  /// 0 if commands are not paced.
+  struct timespec next_slot; /// Earliest time at which the next command may start.
+};
+
+static struct JobPacer pacer = {PTHREAD_MUTEX_INITIALIZER, 0, {0, 0}};
+
+/// Arguments of a job thread.
+struct JobThread {
+  pthread_t tid;
+  const struct JobFile* job;
+  struct JobBarrier* barrier;
+  struct Writer* out;
+  unsigned int thread_id;    /// 1-based id, as used by WAIT.
+  unsigned int num_threads;  /// Number of threads sharing the job.
+};
+
+static int barrier_init(struct JobBarrier* barrier, unsigned int count) {
+  if (pthread_mutex_init(&barrier->mutex, NULL) != 0) {
+    return 1;
+  }
+
+  if (pthread_cond_init(&barrier->cond, NULL) != 0) {
+    pthread_mutex_destroy(&barrier->mutex);
+    return 1;
+  }
+
+  barrier->count = count;
+  barrier->waiting = 0;
+  barrier->generation = 0;
+  return 0;
+}
+
+static void barrier_destroy(struct JobBarrier* barrier) {
+  pthread_cond_destroy(&barrier->cond);
+  pthread_mutex_destroy(&barrier->mutex);
+}
+
+/// Blocks until every thread of the job has reached the barrier.
+/// @param barrier Barrier to wait on.
+static void barrier_wait(struct JobBarrier* barrier) {
+  pthread_mutex_lock(&barrier->mutex);
+
+  unsigned long generation = barrier->generation;
+  if (++barrier->waiting == barrier->count) {
+    barrier->waiting = 0;
+    barrier->generation++;
+    pthread_cond_broadcast(&barrier->cond);
+  } else {
+    while (generation == barrier->generation) {
+      pthread_cond_wait(&barrier->cond, &barrier->mutex);
+    }
+  }
+
+  pthread_mutex_unlock(&barrier->mutex);
+}
+
+void set_job_rate_limit(unsigned int ops_per_sec) {
+  pthread_mutex_lock(&pacer.mutex);
+  pacer.ops_per_sec = ops_per_sec;
+  pacer.next_slot = (struct timespec){0, 0};
+  pthread_mutex_unlock(&pacer.mutex);
+}
+
+/// Blocks until the calling thread may start its next command under the rate limit.
+/// @note Slots are handed out in order from a single timeline, so the rate holds across every thread.
+static void pace_command(void) {
+  pthread_mutex_lock(&pacer.mutex);
+
+  if (pacer.ops_per_sec == 0) {
+    pthread_mutex_unlock(&pacer.mutex);
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  struct timespec slot = pacer.next_slot;
+  if (slot.tv_sec < now.tv_sec || (slot.tv_sec == now.tv_sec && slot.tv_nsec < now.tv_nsec)) {
+    slot = now;
+  }
+
+  long interval_ns = 1000000000L / (long)pacer.ops_per_sec;
+  pacer.next_slot.tv_sec = slot.tv_sec + (slot.tv_nsec + interval_ns) / 1000000000L;
+  pacer.next_slot.tv_nsec = (slot.tv_nsec + interval_ns) % 1000000000L;
+
+  pthread_mutex_unlock(&pacer.mutex);
+
+  // Only a signal cuts the sleep short; any other error leaves the command unpaced instead of spinning
+  int error;
+  while ((error = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &slot, NULL)) == EINTR) {
+  }
+
+  if (error != 0) {
+    fprintf(stderr, "Error pacing command: %s\n", strerror(error));
+  }
+}
+
+enum Command read_job_command(int fd, struct JobCommand* cmd) {
+  *cmd = (struct JobCommand){.type = get_next(fd)};
+
+  switch (cmd->type) {
+    case CMD_CREATE:
+      if (parse_create(fd, &cmd->event_id, &cmd->num_rows, &cmd->num_cols) != 0) {
+        cmd->type = CMD_INVALID;
+      }
+      break;
+
+    case CMD_RESERVE: {
+      size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+      cmd->num_coords = parse_reserve(fd, MAX_RESERVATION_SIZE, &cmd->event_id, xs, ys);
+
+      if (cmd->num_coords == 0) {
+        cmd->type = CMD_INVALID;
+        break;
+      }
+
+      cmd->xs = malloc(cmd->num_coords * sizeof(size_t));
+      cmd->ys = malloc(cmd->num_coords * sizeof(size_t));
+      if (cmd->xs == NULL || cmd->ys == NULL) {
+        fprintf(stderr, "Error allocating memory for reservation\n");
+        free_job_command(cmd);
+        cmd->type = CMD_INVALID;
+        break;
+      }
+
+      memcpy(cmd->xs, xs, cmd->num_coords * sizeof(size_t));
+      memcpy(cmd->ys, ys, cmd->num_coords * sizeof(size_t));
+      break;
+    }
+
+    case CMD_SHOW:
+      if (parse_show(fd, &cmd->event_id) != 0) {
+        cmd->type = CMD_INVALID;
+      }
+      break;
+
+    case CMD_WAIT:
+      switch (parse_wait(fd, &cmd->delay, &cmd->thread_id)) {
+        case -1:
+          cmd->type = CMD_INVALID;
+          break;
+        case 0:
+          cmd->thread_id = 0;
+          break;
+        default:
+          break;
+      }
+      break;
+
+    case CMD_LIST_EVENTS:
+    case CMD_BARRIER:
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+    case EOC:
+      break;
+  }
+
+  return cmd->type;
+}
+
+void free_job_command(struct JobCommand* cmd) {
+  free(cmd->xs);
+  free(cmd->ys);
+  cmd->xs = NULL;
+  cmd->ys = NULL;
+}
+
+int load_job_file(int fd, struct JobFile* job) {
+  job->commands = NULL;
+  job->num_commands = 0;
+  size_t capacity = 0;
+
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+    return 1;
+  }
+
+  while (lseek(fd, 0, SEEK_CUR) < size) {
+    struct JobCommand cmd;
+    if (read_job_command(fd, &cmd) == CMD_EMPTY) {
+      continue;
+    }
+
+    if (job->num_commands == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      struct JobCommand* commands = realloc(job->commands, capacity * sizeof(struct JobCommand));
+      if (commands == NULL) {
+        fprintf(stderr, "Error allocating memory for job commands\n");
+        free_job_command(&cmd);
+        free_job_file(job);
+        return 1;
+      }
+      job->commands = commands;
+    }
+
+    job->commands[job->num_commands++] = cmd;
+  }
+
+  return 0;
+}
+
+void free_job_file(struct JobFile* job) {
+  for (size_t i = 0; i < job->num_commands; i++) {
+    free_job_command(&job->commands[i]);
+  }
+
+  free(job->commands);
+  job->commands = NULL;
+  job->num_commands = 0;
+}
+
+/// Appends a whole message to a writer shared with other threads.
+/// @param out Writer to append to.
+/// @param str Message to append.
+static void print_message(struct Writer* out, const char* str) {
+  writer_lock(out);
+  if (writer_print_str(out, str)) {
+    fprintf(stderr, "Failed to write output\n");
+  }
+  writer_unlock(out);
+}
+
+void execute_command(const struct JobCommand* cmd, struct Writer* out) {
+  switch (cmd->type) {
+    case CMD_CREATE:
+      if (ems_create(cmd->event_id, cmd->num_rows, cmd->num_cols)) {
+        fprintf(stderr, "Failed to create event\n");
+      }
+      break;
+
+    case CMD_RESERVE:
+      if (ems_reserve(cmd->event_id, cmd->num_coords, cmd->xs, cmd->ys)) {
+        fprintf(stderr, "Failed to reserve seats\n");
+      }
+      break;
+
+    case CMD_SHOW:
+      if (ems_show(out, cmd->event_id)) {
+        fprintf(stderr, "Failed to show event\n");
+      }
+      break;
+
+    case CMD_LIST_EVENTS:
+      if (ems_list_events(out)) {
+        fprintf(stderr, "Failed to list events\n");
+      }
+      break;
+
+    case CMD_WAIT:
+      if (cmd->delay > 0) {
+        print_message(out, "Waiting...\n");
+        ems_wait(cmd->delay);
+      }
+      break;
+
+    case CMD_INVALID:
+      fprintf(stderr, "Invalid command. See HELP for usage\n");
+      break;
+
+    case CMD_HELP:
+      print_message(out,
+          "Available commands:\n"
+          "  CREATE <event_id> <num_rows> <num_columns>\n"
+          "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+          "  SHOW <event_id>\n"
+          "  LIST\n"
+          "  WAIT <delay_ms> [thread_id]\n"
+          "  BARRIER\n"
+          "  HELP\n");
+      break;
+
+    case CMD_BARRIER:
+    case CMD_EMPTY:
+    case EOC:
+      break;
+  }
+}
+
+/// Finds the next command that the thread will execute after the given one.
+/// @param self The JobThread describing the thread.
+/// @param i Index of the current command.
+/// @return The next owned command, NULL if there is none before the next BARRIER or the end of the job.
+static const struct JobCommand* next_owned_command(const struct JobThread* self, size_t i) {
+  for (size_t j = i + 1; j < self->job->num_commands; j++) {
+    const struct JobCommand* cmd = &self->job->commands[j];
+    if (cmd->type == CMD_BARRIER) return NULL;
+    if (cmd->type != CMD_WAIT && j % self->num_threads == self->thread_id - 1) return cmd;
+  }
+
+  return NULL;
+}
+
+/// Goes through the commands of a job, executing the ones owned by the thread.
+/// @param arg The JobThread describing the thread.
+/// @return NULL.
+static void* job_thread(void* arg) {
+  const struct JobThread* self = (const struct JobThread*)arg;
+  unsigned int pending_delay = 0;  // Delay injected by WAIT, paid before the next command of this thread
+
+  for (size_t i = 0; i < self->job->num_commands; i++) {
+    const struct JobCommand* cmd = &self->job->commands[i];
+
+    if (cmd->type == CMD_WAIT) {
+      // Every thread sees WAIT; only the targeted one (or all, without a target) is delayed
+      if (cmd->thread_id == 0 || cmd->thread_id == self->thread_id) {
+        if (cmd->delay > 0 && (cmd->thread_id != 0 || self->thread_id == 1)) {
+          print_message(self->out, "Waiting...\n");
+        }
+        pending_delay += cmd->delay;
+      }
+      continue;
+    }
+
+    if (cmd->type != CMD_BARRIER && i % self->num_threads != self->thread_id - 1) {
+      continue;
+    }
+
+    if (pending_delay > 0) {
+      ems_wait(pending_delay);
+      pending_delay = 0;
+    }
+
+    if (cmd->type == CMD_BARRIER) {
+      // Commands run synchronously, so reaching the barrier means this thread has nothing in flight
+      barrier_wait(self->barrier);
+      continue;
+    }
+
+    // Overlap the access delay of the next owned command with the execution of this one
+    const struct JobCommand* next = next_owned_command(self, i);
+    if (next != NULL && (next->type == CMD_RESERVE || next->type == CMD_SHOW)) {
+      ems_prefetch(next->event_id);
+    }
+
+    pace_command();
+    execute_command(cmd, self->out);
+  }
+
+  return NULL;
+}
+
+int execute_job(const struct JobFile* job, unsigned int num_threads, struct Writer* out) {
+  if (num_threads == 0) {
+    return 1;
+  }
+
+  struct JobThread* threads = malloc(num_threads * sizeof(struct JobThread));
+  if (threads == NULL) {
+    fprintf(stderr, "Error allocating memory for job threads\n");
+    return 1;
+  }
+
+  struct JobBarrier barrier;
+  if (barrier_init(&barrier, num_threads) != 0) {
+    fprintf(stderr, "Error initializing job barrier\n");
+    free(threads);
+    return 1;
+  }
+
+  // The threads live for the whole job and meet at every BARRIER, instead of being respawned for each segment
+  int ret = 0;
+  unsigned int started = 0;
+  for (; started < num_threads; started++) {
+    threads[started] = (struct JobThread){
+        .job = job, .barrier = &barrier, .out = out, .thread_id = started + 1, .num_threads = num_threads};
+
+    if (num_threads == 1) {
+      job_thread(&threads[started]);
+    } else if (pthread_create(&threads[started].tid, NULL, job_thread, &threads[started]) != 0) {
+      fprintf(stderr, "Failed to create job thread\n");
+      ret = 1;
+      break;
+    }
+  }
+
+  if (ret != 0) {
+    // The threads already started would wait forever for the missing ones at the first BARRIER
+    pthread_mutex_lock(&barrier.mutex);
+    barrier.count = started;
+    if (started > 0 && barrier.waiting >= started) {
+      barrier.waiting = 0;
+      barrier.generation++;
+      pthread_cond_broadcast(&barrier.cond);
+    }
+    pthread_mutex_unlock(&barrier.mutex);
+  }
+
+  for (unsigned int t = 0; num_threads > 1 && t < started; t++) {
+    pthread_join(threads[t].tid, NULL);
+  }
+
+  barrier_destroy(&barrier);
+  free(threads);
+  return ret;
+}
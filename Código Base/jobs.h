@@ -0,0 +1,71 @@
+#ifndef EMS_JOBS_H
+#define EMS_JOBS_H
+
+#include <stddef.h>
+
+#include "parser.h"
+#include "writer.h"
+
+/// A parsed command of a .jobs file.
+struct JobCommand {
+  enum Command type;  /// CMD_INVALID if the command could not be parsed.
+
+  unsigned int event_id;  /// Event of CREATE, RESERVE and SHOW.
+  size_t num_rows;        /// Number of rows of CREATE.
+  size_t num_cols;        /// Number of columns of CREATE.
+
+  size_t num_coords;  /// Number of seats of RESERVE.
+  size_t* xs;         /// Rows of the seats of RESERVE.
+  size_t* ys;         /// Columns of the seats of RESERVE.
+
+  unsigned int delay;      /// Delay of WAIT, in milliseconds.
+  unsigned int thread_id;  /// Thread targeted by WAIT, 0 if every thread waits.
+};
+
+/// The commands of a .jobs file, in file order.
+struct JobFile {
+  struct JobCommand* commands;
+  size_t num_commands;
+};
+
+/// Reads and parses the next command.
+/// @param fd File descriptor to read from.
+/// @param cmd Command to store the parsed command in. Must be released with free_job_command.
+/// @return The type of the command read.
+enum Command read_job_command(int fd, struct JobCommand* cmd);
+
+/// Releases the memory held by a command.
+/// @param cmd Command to release.
+void free_job_command(struct JobCommand* cmd);
+
+/// Reads every command of a .jobs file.
+/// @param fd File descriptor of the .jobs file, positioned at its start.
+/// @param job Job file to store the commands in. Must be released with free_job_file.
+/// @return 0 if the file was read successfully, 1 otherwise.
+int load_job_file(int fd, struct JobFile* job);
+
+/// Releases the memory held by a job file.
+/// @param job Job file to release.
+void free_job_file(struct JobFile* job);
+
+/// Executes a single command on the calling thread.
+/// @param cmd Command to execute. WAIT is always honoured and BARRIER is ignored.
+/// @param out Writer to print the output of the command to.
+void execute_command(const struct JobCommand* cmd, struct Writer* out);
+
+/// Limits the rate at which job threads start commands.
+/// @note The limit is shared by every thread of every job running in this process.
+/// @param ops_per_sec Maximum number of commands per second, 0 to disable the limit.
+void set_job_rate_limit(unsigned int ops_per_sec);
+
+/// Executes a job file, splitting its commands across threads that share the EMS state.
+/// @note Thread t (1-based) executes the commands whose index i satisfies i % num_threads == t - 1. WAIT and BARRIER
+/// are seen by every thread: WAIT delays the next command of the targeted thread (or of all of them), BARRIER makes
+/// every thread finish the commands before it before any thread proceeds.
+/// @param job Job file to execute.
+/// @param num_threads Number of threads to use.
+/// @param out Writer shared by the threads to print the output of the job to.
+/// @return 0 if the threads were run successfully, 1 otherwise.
+int execute_job(const struct JobFile* job, unsigned int num_threads, struct Writer* out);
+
+#endif  // EMS_JOBS_H
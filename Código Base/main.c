@@ -3,19 +3,37 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <string.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
 #include "constants.h"
+#include "jobs.h"
 #include "operations.h"
 #include "parser.h"
+#include "scheduler.h"
+#include "writer.h"
 
 int executeCommand(int command);
 void removeSubStr(char str[]);
-void executaFicheiro(struct dirent *dp);
+void executaFicheiro(const char *nome, unsigned int max_threads);
 void log_child_completion(pid_t child_pid, const char *file_processed);
+void run_worker(struct WorkPool *pool, unsigned int worker, unsigned int delay_ms);
+struct WorkPool *build_work_pool(DIR *dirp, unsigned int num_workers);
+void *file_worker(void *arg);
+
+/** Writer do modo interativo, que escreve no terminal */
+static struct Writer terminal;
+
+/** Argumentos de uma thread que executa ficheiros no modo com threads */
+struct FileWorker {
+  pthread_t tid;
+  struct WorkPool *pool;
+  unsigned int worker;
+  unsigned int max_threads;
+};
 
 int main(int argc, char *argv[]) {
   unsigned int state_access_delay_ms = STATE_ACCESS_DELAY_MS;
@@ -40,6 +58,11 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  if (writer_init(&terminal, STDOUT_FILENO)) {
+    fprintf(stderr, "Failed to initialize output\n");
+    return 1;
+  }
+
 
   if (argc > 1) {
     if (strcmp(argv[1],"jobs") == 0) {
@@ -54,62 +77,119 @@ int main(int argc, char *argv[]) {
 
       else {
 
-        if (argc > 2) {
+        if (argc > 3) {
           /**
-          * Estamos a verificar se além do nome do programa, há pelo menos dois argumentos adicionais: "jobs" e um valor para MAX_PROC.
+          * Modo com threads: ./ems jobs <MAX_PROC> <MAX_THREADS> [MAX_OPS_PER_SEC]
+          * Os ficheiros são executados neste processo, até MAX_PROC ao mesmo tempo, e partilham o mesmo estado do EMS.
+          * Os comandos de cada ficheiro são divididos por MAX_THREADS threads.
+          * Com MAX_OPS_PER_SEC, o ritmo de todos os comandos fica limitado a esse número por segundo.
           */
-          int max_proc = atoi(argv[2]);
-          int active_children = 0;
-          pid_t child_pids[1024]; // Array para armazenar PIDs dos filhos
-          char file_names[1024][256]; // Array para armazenar nomes dos arquivos
+          int max_threads = atoi(argv[3]);
+          if (max_threads <= 0) {
+            fprintf(stderr, "Invalid MAX_THREADS value\n");
+            return 1;
+          }
 
-          while ((dp = readdir(dirp)) != NULL) {
-             // Processamento dos arquivos .jobs
-            if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
-              continue;
-
-            if (strstr(dp->d_name, ".jobs") != NULL) {
-              if (active_children >= max_proc) {
-                wait(NULL); // Espera que um dos filhos termine
-                active_children--;
-              }
-
-              pid_t pid = fork();
-
-              if (pid == 0) {
-                // Processo filho
-                executaFicheiro(dp);
-                exit(0);
-                } 
-
-              else if (pid > 0) {
-                // Processo pai
-                child_pids[active_children] = pid; // Armazenar o PID do filho
-                strcpy(file_names[active_children], dp->d_name); // Armazenar o nome do arquivo
-                active_children++;
-              }
-
-              else {
-                perror("fork");
-                exit(1);
-              }
+          if (argc > 4) {
+            int max_ops = atoi(argv[4]);
+            if (max_ops < 0) {
+              fprintf(stderr, "Invalid MAX_OPS_PER_SEC value\n");
+              return 1;
             }
+            set_job_rate_limit((unsigned int)max_ops);
           }
-          /*
-          // Esperar todos os filhos terminarem
-          while (active_children > 0) {
-            wait(NULL);
-            active_children--;
+
+          int max_files = atoi(argv[2]);
+          if (max_files <= 0) {
+            fprintf(stderr, "Invalid MAX_PROC value\n");
+            return 1;
           }
+
+          struct WorkPool *pool = build_work_pool(dirp, (unsigned int)max_files);
+          if (pool == NULL) {
+            fprintf(stderr, "Failed to create work pool\n");
+            return 1;
+          }
+
+          unsigned int num_workers = (unsigned int)max_files;
+          if (work_pool_size(pool) < num_workers)
+            num_workers = (unsigned int)work_pool_size(pool);
+
+          struct FileWorker workers[MAX_JOB_FILES];
+          unsigned int started = 0;
+          for (; started < num_workers && started < MAX_JOB_FILES; started++) {
+            workers[started] =
+                (struct FileWorker){.pool = pool, .worker = started, .max_threads = (unsigned int)max_threads};
+            if (pthread_create(&workers[started].tid, NULL, file_worker, &workers[started]) != 0) {
+              fprintf(stderr, "Failed to create file worker\n");
+              break;
+            }
+          }
+
+          /* se nenhuma thread foi criada, os ficheiros são executados pela thread principal */
+          if (started == 0 && num_workers > 0) {
+            workers[0] = (struct FileWorker){.pool = pool, .worker = 0, .max_threads = (unsigned int)max_threads};
+            file_worker(&workers[0]);
+          }
+
+          for (unsigned int ix = 0; ix < started; ix++) {
+            pthread_join(workers[ix].tid, NULL);
+          }
+
+          free_work_pool(pool);
+        }
+
+        else if (argc > 2) {
+          /**
+          * Estamos a verificar se além do nome do programa, há pelo menos dois argumentos adicionais: "jobs" e um valor para MAX_PROC.
+          * Os ficheiros são distribuídos por MAX_PROC processos trabalhadores, maiores primeiro, e um trabalhador sem
+          * ficheiros rouba ficheiros ao trabalhador com mais trabalho por fazer.
           */
-          // Esperar todos os filhos terminarem
-          for (int ix = 0; ix < active_children; ix++) {
-            pid_t completed_pid = waitpid(child_pids[ix], NULL, 0); // Espera pelo PID específico
-            /** usei waitpid em vez de wait para que possamos rastrear a conclusão de cada processo filho individualmente 
-             * e não apenas o primeiro processo filho que termina. 
-            */
-            log_child_completion(completed_pid, file_names[ix]); // Log do processo filho completado
+          int max_proc = atoi(argv[2]);
+          if (max_proc <= 0) {
+            fprintf(stderr, "Invalid MAX_PROC value\n");
+            return 1;
+          }
+
+          struct WorkPool *pool = build_work_pool(dirp, (unsigned int)max_proc);
+          if (pool == NULL) {
+            fprintf(stderr, "Failed to create work pool\n");
+            return 1;
+          }
+
+          unsigned int num_workers = (unsigned int)max_proc;
+          if (work_pool_size(pool) < num_workers)
+            num_workers = (unsigned int)work_pool_size(pool);
+
+          pid_t child_pids[MAX_JOB_FILES]; // Array para armazenar PIDs dos trabalhadores
+          unsigned int active_children = 0;
+
+          for (unsigned int w = 0; w < num_workers && active_children < MAX_JOB_FILES; w++) {
+            pid_t pid = fork();
+
+            if (pid == 0) {
+              // Processo filho
+              run_worker(pool, w, state_access_delay_ms);
+              exit(0);
+            }
+
+            else if (pid > 0) {
+              // Processo pai
+              child_pids[active_children++] = pid;
+            }
+
+            else {
+              perror("fork");
+              exit(1);
+            }
           }
+
+          // Esperar todos os trabalhadores terminarem
+          for (unsigned int ix = 0; ix < active_children; ix++) {
+            waitpid(child_pids[ix], NULL, 0);
+          }
+
+          free_work_pool(pool);
         }
         
         else {
@@ -125,7 +205,7 @@ int main(int argc, char *argv[]) {
 
             /* se o nome do ficheiro tiver extensão ".jobs" */
             if (strstr(dp->d_name,".jobs") != NULL)
-              executaFicheiro(dp);
+              executaFicheiro(dp->d_name, 1);
           }
 
         }
@@ -154,93 +234,73 @@ void log_child_completion(pid_t child_pid, const char *file_processed) {
     printf("Processo filho com PID %d completou o processamento de '%s'\n", child_pid, file_processed);
 }
 
-int executeCommand(int command){
-  unsigned int event_id, delay;
-    
-  size_t num_rows, num_columns, num_coords;
-  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
-  
-  switch (get_next(command)) {
-      case CMD_CREATE:
-        if (parse_create(command, &event_id, &num_rows, &num_columns) != 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-        }
-
-        if (ems_create(event_id, num_rows, num_columns)) {
-          fprintf(stderr, "Failed to create event\n");
-        }
-
-        return 1;
-
-      case CMD_RESERVE:
-        num_coords = parse_reserve(command, MAX_RESERVATION_SIZE, &event_id, xs, ys);
-
-        if (num_coords == 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-        }
-
-        if (ems_reserve(event_id, num_coords, xs, ys)) {
-          fprintf(stderr, "Failed to reserve seats\n");
-        }
+/** Função executada por cada processo trabalhador: processa ficheiros da pool até não haver trabalho */
+void run_worker(struct WorkPool *pool, unsigned int worker, unsigned int delay_ms) {
+  char nome[MAX_JOB_FILE_NAME];
 
-        return 1;
-
-      case CMD_SHOW:
-        if (parse_show(command, &event_id) != 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-        }
-
-        if (ems_show(event_id)) {
-          fprintf(stderr, "Failed to show event\n");
-        }
-
-        return 1;
+  while (work_pool_take(pool, worker, nome) == 0) {
+    /* cada ficheiro começa com um estado do EMS vazio, como quando tinha um processo só para si */
+    ems_terminate();
+    if (ems_init(delay_ms)) {
+      fprintf(stderr, "Failed to initialize EMS\n");
+      exit(1);
+    }
 
-      case CMD_LIST_EVENTS:
-        if (ems_list_events()) {
-          fprintf(stderr, "Failed to list events\n");
-        }
+    executaFicheiro(nome, 1);
+    log_child_completion(getpid(), nome);
+    fflush(stdout);
+  }
+}
 
-        return 1;
+/** Cria uma pool com os ficheiros .jobs da diretoria, distribuídos por num_workers trabalhadores */
+struct WorkPool *build_work_pool(DIR *dirp, unsigned int num_workers) {
+  struct WorkPool *pool = create_work_pool(num_workers);
+  if (pool == NULL)
+    return NULL;
+
+  struct dirent *dp;
+  while ((dp = readdir(dirp)) != NULL) {
+    if (strstr(dp->d_name, ".jobs") == NULL)
+      continue;
+
+    /* o tamanho do ficheiro serve de estimativa do trabalho que dá */
+    struct stat st;
+    off_t cost = stat(dp->d_name, &st) == 0 ? st.st_size : 0;
+    if (work_pool_add(pool, dp->d_name, cost) != 0) {
+      fprintf(stderr, "Skipping '%s': too many .jobs files or name too long\n", dp->d_name);
+    }
+  }
 
-      case CMD_WAIT:
-        if (parse_wait(command, &delay, NULL) == -1) {  // thread_id is not implemented
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-        }
+  work_pool_distribute(pool);
+  return pool;
+}
 
-        if (delay > 0) {
-          printf("Waiting...\n");
-          ems_wait(delay);
-        }
+/** Função executada por cada thread do modo com threads: executa ficheiros da pool até não haver trabalho */
+void *file_worker(void *arg) {
+  struct FileWorker *self = (struct FileWorker *)arg;
+  char nome[MAX_JOB_FILE_NAME];
 
-        return 1;
+  while (work_pool_take(self->pool, self->worker, nome) == 0) {
+    executaFicheiro(nome, self->max_threads);
+  }
 
-      case CMD_INVALID:
-        fprintf(stderr, "Invalid command. See HELP for usage\n");
-        return 1;
+  return NULL;
+}
 
-      case CMD_HELP:
-        printf(
-            "Available commands:\n"
-            "  CREATE <event_id> <num_rows> <num_columns>\n"
-            "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
-            "  SHOW <event_id>\n"
-            "  LIST\n"
-            "  WAIT <delay_ms> [thread_id]\n"  // thread_id is not implemented
-            "  BARRIER\n"                      // Not implemented
-            "  HELP\n");
+int executeCommand(int command){
+  struct JobCommand cmd;
 
-        return 1;
+  if (read_job_command(command, &cmd) == EOC) {
+    ems_terminate();
+    return 0;
+  }
 
-      case CMD_BARRIER:  // Not implemented
-      case CMD_EMPTY:
-        return 1;
+  execute_command(&cmd, &terminal);
+  free_job_command(&cmd);
 
-      case EOC:
-        ems_terminate();
-        return 0;
-    }
-    return 0;
+  if (writer_flush(&terminal) != 0)
+    perror("write failed");
+  return 1;
 }
 
 void removeSubStr(char str[]){
@@ -256,64 +316,59 @@ void removeSubStr(char str[]){
     
 }
 
-void executaFicheiro(struct dirent *dp){
+void executaFicheiro(const char *nome, unsigned int max_threads){
   /*outputname é o nome do ficheiro output a ser criado*/
-  char outputname[strlen(dp->d_name) + 1];
-  strcpy(outputname,dp->d_name);
+  char outputname[strlen(nome) + 1];
+  strcpy(outputname,nome);
   removeSubStr(outputname);
   strcat(outputname,".out");
   /*declaraçao dos file descriptores*/
-  int file,outfile, fd;
+  int file,outfile;
 
-  /*cria um ficheiro de nom outname para o file descriptor outfile*/
-  outfile = open(outputname,O_WRONLY | O_CREAT, 0644);
+  /*abre o ficheiro de input*/
+  file = open(nome,O_RDONLY);
+  if (file == -1) {
+    fprintf(stderr, "error opening file %s\n", nome);
+    return;
+  }
+
+  /*cria um ficheiro de nome outputname para o file descriptor outfile*/
+  outfile = open(outputname,O_WRONLY | O_CREAT | O_TRUNC, 0644);
   if (outfile == -1) {
     perror("open failed");
     exit(1);
   }
 
-  /*abre o ficheiro dp*/
-  file = open(dp->d_name,O_RDONLY);
-  if (file == -1)
-     printf("error opening file %s", dp->d_name);
-  /** fd=dub(1) cria um novo file descriptor  que é basicamente um ponteiro para o ficheiro stdout "1"
-  preciseide fazer isto porque tive que alterar momentaneamente o ficheiro de output (em ve de se no terminal "1" passará a ser no ficheiro criado)
-  */
-  fd = dup(1);
-  if (fd == -1) {
-    perror("dup failed"); 
-    exit(1);
-  }
-  /** dup2(outfile,1) altera o ficheiro de output (da terminal para outfile)*/
-  if (dup2(outfile, 1) == -1) {
-    perror("dup2 failed"); 
-    exit(1);
+  /** o output do ficheiro é escrito através de um writer próprio, em blocos, em vez de redirecionar o stdout com dup2;
+   * assim vários ficheiros podem ser executados ao mesmo tempo no mesmo processo
+   */
+  struct Writer *out = malloc(sizeof(struct Writer));
+  if (out == NULL || writer_init(out, outfile) != 0) {
+    fprintf(stderr, "Failed to create writer for %s\n", outputname);
+    free(out);
+    close(file);
+    close(outfile);
+    return;
   }
 
-  /*tamanho do ficheiro "file" a ser lido*/
-  long int size=lseek(file,0,SEEK_END);
-  /*coloca o cursor no inicio de "file"*/
-  lseek(file,0,SEEK_SET );
-  /*enquanto o cursor não chegar ao final */
-  while(lseek(file,0,SEEK_CUR) != size){
-  /*executa comandos*/
-    executeCommand(file);
+  /*lê todos os comandos do ficheiro e executa-os, divididos por max_threads threads*/
+  struct JobFile job;
+  if (load_job_file(file, &job) != 0) {
+    fprintf(stderr, "Failed to read %s\n", nome);
+  } else {
+    if (execute_job(&job, max_threads, out) != 0)
+      fprintf(stderr, "Failed to execute %s\n", nome);
+    free_job_file(&job);
   }
-  /*reset do cursor (não sei se é necessário mas são 4am e o meu cérebro já não funciona bem)*/
-  lseek(file,0,SEEK_SET);
+
+  if (writer_flush(out) != 0)
+    perror("write failed");
+  writer_destroy(out);
+  free(out);
 
   /*fecha os ficheiros*/
   if (close(file) == -1)
-    printf("close input");
+    perror("close input");
   if (close(outfile) == -1)
-    printf("close input");
-            
-  /*não sei oq faz só sei que sem isto n funciona lol*/
-  fflush(stdout);
-
-  /*volta a alterar o ficheiro de output [de outfile (onde 1 está a apontar agora) para o stdout (onde fd está a apontar)] */
-  if (dup2(fd, 1) == -1) {
-    perror("dup2 failed"); 
-    exit(1);
-  }
+    perror("close output");
 }
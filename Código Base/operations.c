@@ -1,8 +1,12 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "constants.h"
 #include "eventlist.h"
+#include "operations.h"
 
 static struct EventList* event_list = NULL;
 static unsigned int state_access_delay_ms = 0;
@@ -16,25 +20,154 @@ static struct timespec delay_to_timespec(unsigned int delay_ms) {
 
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
+/// @note The list lock is only taken after the wait, so concurrent lookups are not serialized by it.
 /// @param event_id The ID of the event to get.
 /// @return Pointer to the event if found, NULL otherwise.
 static struct Event* get_event_with_delay(unsigned int event_id) {
   struct timespec delay = delay_to_timespec(state_access_delay_ms);
   nanosleep(&delay, NULL);  // Should not be removed
 
-  return get_event(event_list, event_id);
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return NULL;
+  }
+
+  struct Event* event = get_event(event_list, event_id);
+  pthread_rwlock_unlock(&event_list->rwl);
+
+  return event;
 }
 
-/// Gets the seat with the given index from the state.
-/// @note Will wait to simulate a real system accessing a costly memory resource.
-/// @param event Event to get the seat from.
-/// @param index Index of the seat to get.
-/// @return Pointer to the seat.
-static unsigned int* get_seat_with_delay(struct Event* event, size_t index) {
-  struct timespec delay = delay_to_timespec(state_access_delay_ms);
-  nanosleep(&delay, NULL);  // Should not be removed
+/// State of a prefetch slot.
+enum PrefetchState {
+  PREFETCH_FREE,      /// The slot is unused.
+  PREFETCH_QUEUED,    /// The event was requested but the helper has not started fetching it.
+  PREFETCH_FETCHING,  /// The helper is paying the access delay for the event.
+  PREFETCH_READY      /// The event was fetched and waits to be consumed.
+};
+
+struct PrefetchSlot {
+  enum PrefetchState state;
+  unsigned int event_id;
+  unsigned int requests;  /// Lookups still expected to use the slot.
+  struct Event* event;    /// Fetched event, only valid when READY.
+};
+
+/// Events requested with ems_prefetch, fetched from the state by a helper thread.
+/// @note The helper is started on the first request and belongs to the process that started it, so a forked worker
+/// starts its own instead of inheriting a thread that does not exist there.
+static struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;  // Signalled whenever a slot changes state
+  struct PrefetchSlot slots[PREFETCH_SLOTS];
+  pthread_t helper;
+  pid_t helper_pid;  // Process running the helper, 0 if there is none
+  int stopping;
+} prefetcher = {.mutex = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER};
+
+/// Finds the slot of an event.
+/// @note Must be called with the prefetcher mutex held.
+/// @param event_id Id of the event to find.
+/// @return The slot, NULL if the event was not requested.
+static struct PrefetchSlot* find_prefetch(unsigned int event_id) {
+  for (size_t i = 0; i < PREFETCH_SLOTS; i++) {
+    struct PrefetchSlot* slot = &prefetcher.slots[i];
+    if (slot->state != PREFETCH_FREE && slot->event_id == event_id) return slot;
+  }
+
+  return NULL;
+}
+
+/// Fetches the event of a slot and publishes it to the lookups waiting for it.
+/// @note Must be called with the prefetcher mutex held and the slot QUEUED; the mutex is released during the fetch.
+/// @param slot Slot to fetch.
+/// @return The event if found, NULL otherwise.
+static struct Event* fetch_prefetch(struct PrefetchSlot* slot) {
+  slot->state = PREFETCH_FETCHING;
+  unsigned int event_id = slot->event_id;
+  pthread_mutex_unlock(&prefetcher.mutex);
+
+  struct Event* event = get_event_with_delay(event_id);
+
+  pthread_mutex_lock(&prefetcher.mutex);
+  // Only events that exist are kept: one missing now may still be created before it is used
+  slot->event = event;
+  slot->state = event != NULL ? PREFETCH_READY : PREFETCH_FREE;
+  pthread_cond_broadcast(&prefetcher.changed);
 
-  return &event->data[index];
+  return event;
+}
+
+/// Helper thread: fetches the queued events, overlapping their access delay with the work of the job threads.
+/// @param arg Unused.
+/// @return NULL.
+static void* prefetch_helper(void* arg) {
+  (void)arg;
+
+  pthread_mutex_lock(&prefetcher.mutex);
+  while (!prefetcher.stopping) {
+    struct PrefetchSlot* slot = NULL;
+    for (size_t i = 0; i < PREFETCH_SLOTS && slot == NULL; i++) {
+      if (prefetcher.slots[i].state == PREFETCH_QUEUED) slot = &prefetcher.slots[i];
+    }
+
+    if (slot == NULL) {
+      pthread_cond_wait(&prefetcher.changed, &prefetcher.mutex);
+      continue;
+    }
+
+    fetch_prefetch(slot);
+  }
+  pthread_mutex_unlock(&prefetcher.mutex);
+
+  return NULL;
+}
+
+/// Stops the helper thread and drops every prefetched event.
+static void stop_prefetcher(void) {
+  pthread_mutex_lock(&prefetcher.mutex);
+  int owned = prefetcher.helper_pid == getpid();
+  prefetcher.stopping = 1;
+  pthread_cond_broadcast(&prefetcher.changed);
+  pthread_mutex_unlock(&prefetcher.mutex);
+
+  if (owned) {
+    pthread_join(prefetcher.helper, NULL);
+  }
+
+  for (size_t i = 0; i < PREFETCH_SLOTS; i++) {
+    prefetcher.slots[i].state = PREFETCH_FREE;
+  }
+  prefetcher.helper_pid = 0;
+  prefetcher.stopping = 0;
+}
+
+/// Gets the event with the given ID, using the prefetched copy if there is one.
+/// @note Each lookup uses up one request of the slot; one still being fetched is waited for, and one still queued is
+/// fetched by the caller itself.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* lookup_event(unsigned int event_id) {
+  pthread_mutex_lock(&prefetcher.mutex);
+
+  struct PrefetchSlot* slot = find_prefetch(event_id);
+  while (slot != NULL && slot->state == PREFETCH_FETCHING) {
+    pthread_cond_wait(&prefetcher.changed, &prefetcher.mutex);
+    slot = find_prefetch(event_id);
+  }
+
+  if (slot == NULL) {
+    pthread_mutex_unlock(&prefetcher.mutex);
+    return get_event_with_delay(event_id);
+  }
+
+  struct Event* event = slot->state == PREFETCH_QUEUED ? fetch_prefetch(slot) : slot->event;
+  if (slot->state == PREFETCH_READY && --slot->requests == 0) {
+    slot->state = PREFETCH_FREE;
+  }
+
+  pthread_mutex_unlock(&prefetcher.mutex);
+  return event;
 }
 
 /// Gets the index of a seat.
@@ -45,6 +178,48 @@ static unsigned int* get_seat_with_delay(struct Event* event, size_t index) {
 /// @return Index of the seat.
 static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
 
+/// Gets a whole row of seats from the state.
+/// @note Will wait to simulate a real system accessing a costly memory resource. The row is the unit of access, so
+/// callers fetch each row they need once per operation instead of paying the delay for every seat.
+/// @param event Event to get the row from.
+/// @param row Row to get, starting at 1.
+/// @return Pointer to the first seat of the row.
+static unsigned int* get_row_with_delay(struct Event* event, size_t row) {
+  struct timespec delay = delay_to_timespec(state_access_delay_ms);
+  nanosleep(&delay, NULL);  // Should not be removed
+
+  return &event->data[seat_index(event, row, 1)];
+}
+
+/// Rows of an event already fetched by the current operation.
+struct FetchedRows {
+  size_t count;
+  size_t rows[MAX_RESERVATION_SIZE];
+  unsigned int* data[MAX_RESERVATION_SIZE];
+};
+
+/// Gets a row through the rows already fetched by the operation, fetching it from the state only the first time.
+/// @param event Event to get the row from.
+/// @param fetched Rows already fetched by the operation.
+/// @param row Row to get, starting at 1.
+/// @return Pointer to the first seat of the row.
+static unsigned int* fetch_row(struct Event* event, struct FetchedRows* fetched, size_t row) {
+  for (size_t i = 0; i < fetched->count; i++) {
+    if (fetched->rows[i] == row) {
+      return fetched->data[i];
+    }
+  }
+
+  unsigned int* data = get_row_with_delay(event, row);
+  if (fetched->count < MAX_RESERVATION_SIZE) {
+    fetched->rows[fetched->count] = row;
+    fetched->data[fetched->count] = data;
+    fetched->count++;
+  }
+
+  return data;
+}
+
 int ems_init(unsigned int delay_ms) {
   if (event_list != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
@@ -63,7 +238,9 @@ int ems_terminate() {
     return 1;
   }
 
+  stop_prefetcher();
   free_list(event_list);
+  event_list = NULL;
   return 0;
 }
 
@@ -97,17 +274,36 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
+  if (pthread_mutex_init(&event->mutex, NULL) != 0) {
+    fprintf(stderr, "Error initializing event mutex\n");
+    free(event->data);
+    free(event);
+    return 1;
+  }
+
   for (size_t i = 0; i < num_rows * num_cols; i++) {
     event->data[i] = 0;
   }
 
-  if (append_to_list(event_list, event) != 0) {
+  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    pthread_mutex_destroy(&event->mutex);
+    free(event->data);
+    free(event);
+    return 1;
+  }
+
+  // Another thread may have created the same event while this one was waiting for the state
+  if (get_event(event_list, event_id) != NULL || append_to_list(event_list, event) != 0) {
     fprintf(stderr, "Error appending event to list\n");
+    pthread_rwlock_unlock(&event_list->rwl);
+    pthread_mutex_destroy(&event->mutex);
     free(event->data);
     free(event);
     return 1;
   }
 
+  pthread_rwlock_unlock(&event_list->rwl);
   return 0;
 }
 
@@ -117,15 +313,29 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id);
+  struct Event* event = lookup_event(event_id);
 
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
     return 1;
   }
 
+  if (num_seats > MAX_RESERVATION_SIZE) {
+    fprintf(stderr, "Too many seats\n");
+    return 1;
+  }
+
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+
   unsigned int reservation_id = ++event->reservations;
 
+  // Each row is fetched once and reused for checking, reserving and rolling back its seats
+  struct FetchedRows fetched = {.count = 0};
+  unsigned int* seats[MAX_RESERVATION_SIZE];
+
   size_t i = 0;
   for (; i < num_seats; i++) {
     size_t row = xs[i];
@@ -136,74 +346,147 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
       break;
     }
 
-    if (*get_seat_with_delay(event, seat_index(event, row, col)) != 0) {
+    seats[i] = &fetch_row(event, &fetched, row)[col - 1];
+
+    if (*seats[i] != 0) {
       fprintf(stderr, "Seat already reserved\n");
       break;
     }
 
-    *get_seat_with_delay(event, seat_index(event, row, col)) = reservation_id;
+    *seats[i] = reservation_id;
   }
 
   // If the reservation was not successful, free the seats that were reserved.
   if (i < num_seats) {
     event->reservations--;
     for (size_t j = 0; j < i; j++) {
-      *get_seat_with_delay(event, seat_index(event, xs[j], ys[j])) = 0;
+      *seats[j] = 0;
     }
+    pthread_mutex_unlock(&event->mutex);
     return 1;
   }
 
+  pthread_mutex_unlock(&event->mutex);
   return 0;
 }
 
-int ems_show(unsigned int event_id) {
+int ems_show(struct Writer* out, unsigned int event_id) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id);
+  struct Event* event = lookup_event(event_id);
 
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
     return 1;
   }
 
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+
+  // The event is rendered first and appended to the writer in one go, so the writer is not held during the delays
+  char* text = malloc(event->rows * (event->cols * 11 + 1) + 1);
+  if (text == NULL) {
+    fprintf(stderr, "Error allocating memory for event output\n");
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+
+  size_t len = 0;
   for (size_t i = 1; i <= event->rows; i++) {
+    unsigned int* row = get_row_with_delay(event, i);
+
     for (size_t j = 1; j <= event->cols; j++) {
-      unsigned int* seat = get_seat_with_delay(event, seat_index(event, i, j));
-      printf("%u", *seat);
+      len += (size_t)sprintf(text + len, "%u", row[j - 1]);
 
       if (j < event->cols) {
-        printf(" ");
+        text[len++] = ' ';
       }
     }
 
-    printf("\n");
+    text[len++] = '\n';
   }
 
-  return 0;
+  pthread_mutex_unlock(&event->mutex);
+
+  writer_lock(out);
+  int ret = writer_write(out, text, len);
+  writer_unlock(out);
+
+  free(text);
+  return ret;
 }
 
-int ems_list_events() {
+int ems_list_events(struct Writer* out) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  writer_lock(out);
+
   if (event_list->head == NULL) {
-    printf("No events\n");
-    return 0;
+    int ret = writer_print_str(out, "No events\n");
+    writer_unlock(out);
+    pthread_rwlock_unlock(&event_list->rwl);
+    return ret;
   }
 
+  int ret = 0;
   struct ListNode* current = event_list->head;
-  while (current != NULL) {
-    printf("Event: ");
-    printf("%u\n", (current->event)->id);
+  while (current != NULL && ret == 0) {
+    ret = writer_print_str(out, "Event: ") || writer_print_uint(out, (current->event)->id) ||
+          writer_print_str(out, "\n");
     current = current->next;
   }
 
-  return 0;
+  writer_unlock(out);
+  pthread_rwlock_unlock(&event_list->rwl);
+  return ret;
+}
+
+void ems_prefetch(unsigned int event_id) {
+  if (event_list == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&prefetcher.mutex);
+
+  if (prefetcher.helper_pid != getpid()) {
+    if (pthread_create(&prefetcher.helper, NULL, prefetch_helper, NULL) != 0) {
+      pthread_mutex_unlock(&prefetcher.mutex);
+      return;
+    }
+    prefetcher.helper_pid = getpid();
+  }
+
+  // Requests for an event already being prefetched share its fetch; new ones are dropped if every slot is busy
+  struct PrefetchSlot* slot = find_prefetch(event_id);
+  if (slot != NULL) {
+    slot->requests++;
+  } else {
+    for (size_t i = 0; i < PREFETCH_SLOTS; i++) {
+      slot = &prefetcher.slots[i];
+      if (slot->state == PREFETCH_FREE) {
+        slot->state = PREFETCH_QUEUED;
+        slot->event_id = event_id;
+        slot->requests = 1;
+        pthread_cond_broadcast(&prefetcher.changed);
+        break;
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&prefetcher.mutex);
 }
 
 void ems_wait(unsigned int delay_ms) {
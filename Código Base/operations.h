@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 
+#include "writer.h"
+
 /// Initializes the EMS state.
 /// @param delay_ms State access delay in milliseconds.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
@@ -27,13 +29,20 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
 
 /// Prints the given event.
+/// @param out Writer to print the event to.
 /// @param event_id Id of the event to print.
 /// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(unsigned int event_id);
+int ems_show(struct Writer *out, unsigned int event_id);
 
 /// Prints all the events.
+/// @param out Writer to print the events to.
 /// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events();
+int ems_list_events(struct Writer *out);
+
+/// Starts fetching an event in the background, so that a later RESERVE or SHOW of it does not pay the access delay.
+/// @note Only a hint: the request is dropped if too many events are already being prefetched.
+/// @param event_id Id of the event that is about to be used.
+void ems_prefetch(unsigned int event_id);
 
 /// Waits for a given amount of time.
 /// @param delay_us Delay in milliseconds.
@@ -0,0 +1,152 @@
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS
+
+#include "scheduler.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+struct WorkItem {
+  char name[MAX_JOB_FILE_NAME];
+  off_t cost;
+};
+
+/// Deque of a worker: the owner takes from the head, thieves take from the tail.
+struct WorkDeque {
+  pthread_mutex_t mutex;
+  size_t head;              /// Index in slots of the next file for the owner.
+  size_t tail;              /// One past the last file in slots.
+  off_t remaining;          /// Total cost of the files still in the deque.
+  size_t slots[MAX_JOB_FILES];  /// Indices in the pool's items.
+};
+
+struct WorkPool {
+  size_t mapping_size;
+  unsigned int num_workers;
+  size_t num_items;
+  struct WorkItem items[MAX_JOB_FILES];
+  struct WorkDeque deques[];  /// One per worker.
+};
+
+struct WorkPool* create_work_pool(unsigned int num_workers) {
+  if (num_workers == 0) return NULL;
+
+  size_t size = sizeof(struct WorkPool) + num_workers * sizeof(struct WorkDeque);
+  struct WorkPool* pool = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (pool == MAP_FAILED) return NULL;
+
+  pool->mapping_size = size;
+  pool->num_workers = num_workers;
+  pool->num_items = 0;
+
+  pthread_mutexattr_t attr;
+  if (pthread_mutexattr_init(&attr) != 0) {
+    munmap(pool, size);
+    return NULL;
+  }
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+
+  for (unsigned int w = 0; w < num_workers; w++) {
+    struct WorkDeque* deque = &pool->deques[w];
+    deque->head = 0;
+    deque->tail = 0;
+    deque->remaining = 0;
+
+    if (pthread_mutex_init(&deque->mutex, &attr) != 0) {
+      for (unsigned int i = 0; i < w; i++) pthread_mutex_destroy(&pool->deques[i].mutex);
+      pthread_mutexattr_destroy(&attr);
+      munmap(pool, size);
+      return NULL;
+    }
+  }
+
+  pthread_mutexattr_destroy(&attr);
+  return pool;
+}
+
+int work_pool_add(struct WorkPool* pool, const char* name, off_t cost) {
+  if (pool->num_items == MAX_JOB_FILES || strlen(name) >= MAX_JOB_FILE_NAME) return 1;
+
+  struct WorkItem* item = &pool->items[pool->num_items++];
+  strcpy(item->name, name);
+  item->cost = cost;
+  return 0;
+}
+
+static int compare_cost_desc(const void* a, const void* b) {
+  const struct WorkItem* x = (const struct WorkItem*)a;
+  const struct WorkItem* y = (const struct WorkItem*)b;
+  return (x->cost < y->cost) - (x->cost > y->cost);
+}
+
+void work_pool_distribute(struct WorkPool* pool) {
+  qsort(pool->items, pool->num_items, sizeof(struct WorkItem), compare_cost_desc);
+
+  for (size_t i = 0; i < pool->num_items; i++) {
+    unsigned int target = 0;
+    for (unsigned int w = 1; w < pool->num_workers; w++) {
+      if (pool->deques[w].remaining < pool->deques[target].remaining) target = w;
+    }
+
+    struct WorkDeque* deque = &pool->deques[target];
+    deque->slots[deque->tail++] = i;
+    deque->remaining += pool->items[i].cost;
+  }
+}
+
+size_t work_pool_size(const struct WorkPool* pool) { return pool->num_items; }
+
+int work_pool_take(struct WorkPool* pool, unsigned int worker, char* name) {
+  struct WorkDeque* own = &pool->deques[worker];
+
+  pthread_mutex_lock(&own->mutex);
+  if (own->head < own->tail) {
+    struct WorkItem* item = &pool->items[own->slots[own->head++]];
+    own->remaining -= item->cost;
+    strcpy(name, item->name);
+    pthread_mutex_unlock(&own->mutex);
+    return 0;
+  }
+  pthread_mutex_unlock(&own->mutex);
+
+  // Steal from the victim with the most work left; retry if it was emptied in the meantime
+  while (1) {
+    unsigned int victim = worker;
+    off_t most = -1;
+    for (unsigned int w = 0; w < pool->num_workers; w++) {
+      if (w == worker) continue;
+
+      struct WorkDeque* deque = &pool->deques[w];
+      pthread_mutex_lock(&deque->mutex);
+      if (deque->head < deque->tail && deque->remaining > most) {
+        most = deque->remaining;
+        victim = w;
+      }
+      pthread_mutex_unlock(&deque->mutex);
+    }
+
+    if (victim == worker) return 1;
+
+    struct WorkDeque* deque = &pool->deques[victim];
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->head < deque->tail) {
+      struct WorkItem* item = &pool->items[deque->slots[--deque->tail]];
+      deque->remaining -= item->cost;
+      strcpy(name, item->name);
+      pthread_mutex_unlock(&deque->mutex);
+      return 0;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+  }
+}
+
+void free_work_pool(struct WorkPool* pool) {
+  if (!pool) return;
+
+  for (unsigned int w = 0; w < pool->num_workers; w++) {
+    pthread_mutex_destroy(&pool->deques[w].mutex);
+  }
+
+  munmap(pool, pool->mapping_size);
+}
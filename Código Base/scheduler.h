@@ -0,0 +1,45 @@
+#ifndef EMS_SCHEDULER_H
+#define EMS_SCHEDULER_H
+
+#include <sys/types.h>
+
+#include "constants.h"
+
+/// Pool of .jobs files distributed over per-worker deques.
+/// @note The pool lives in shared memory, so it can be used by forked worker processes as well as by threads.
+struct WorkPool;
+
+/// Creates an empty work pool.
+/// @param num_workers Number of workers that will take files from the pool.
+/// @return Newly created pool, NULL on failure.
+struct WorkPool* create_work_pool(unsigned int num_workers);
+
+/// Adds a file to the pool. Must be called before work_pool_distribute.
+/// @param pool Pool to add the file to.
+/// @param name Name of the .jobs file.
+/// @param cost Estimated cost of the file, e.g. its size in bytes.
+/// @return 0 if the file was added successfully, 1 otherwise.
+int work_pool_add(struct WorkPool* pool, const char* name, off_t cost);
+
+/// Deals the files over the workers' deques, largest first, each to the least loaded worker.
+/// @param pool Pool to distribute.
+void work_pool_distribute(struct WorkPool* pool);
+
+/// Number of files in the pool.
+/// @param pool Pool to query.
+/// @return Number of files added to the pool.
+size_t work_pool_size(const struct WorkPool* pool);
+
+/// Takes the next file for a worker: from the front of its own deque or, when that is empty, from the back of the
+/// deque with the most remaining work.
+/// @param pool Pool to take the file from.
+/// @param worker Index of the worker, from 0 to num_workers - 1.
+/// @param name Buffer of MAX_JOB_FILE_NAME characters to store the file name in.
+/// @return 0 if a file was taken, 1 if there is no work left.
+int work_pool_take(struct WorkPool* pool, unsigned int worker, char* name);
+
+/// Destroys a work pool.
+/// @param pool Pool to destroy.
+void free_work_pool(struct WorkPool* pool);
+
+#endif  // EMS_SCHEDULER_H
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Runs the .jobs files of this directory in every batch mode of ems and compares the output of each one with the .out
+# file next to it. Every file uses its own events and orders its output with BARRIER, so that it is the same whether
+# the files share the EMS state and however many threads run them.
+# Usage: tests/run.sh <ems binary>
+
+ems=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+tests=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failed=0
+# Sequential, work-stealing processes, threads sharing the state, and threads under a rate limit
+for mode in "" "2" "2 3" "1 2 500"; do
+  rm -rf "$work/jobs"
+  mkdir "$work/jobs"
+  cp "$tests"/*.jobs "$work/jobs"
+  # Without MAX_PROC, ems goes on to read commands from stdin once the files are done
+  (cd "$work" && "$ems" jobs $mode </dev/null >/dev/null 2>&1)
+
+  for jobs in "$tests"/*.jobs; do
+    name=$(basename "$jobs" .jobs)
+    if ! diff -u "$tests/$name.out" "$work/jobs/$name.out"; then
+      echo "FAIL: $name (ems jobs $mode)"
+      failed=1
+    fi
+  done
+done
+
+[ $failed -eq 0 ] && echo "All tests passed"
+exit $failed
@@ -0,0 +1,63 @@
+#include "writer.h"
+
+#include <string.h>
+#include <unistd.h>
+
+int writer_init(struct Writer *writer, int fd) {
+  writer->fd = fd;
+  writer->len = 0;
+  return pthread_mutex_init(&writer->mutex, NULL) != 0;
+}
+
+void writer_destroy(struct Writer *writer) { pthread_mutex_destroy(&writer->mutex); }
+
+void writer_lock(struct Writer *writer) { pthread_mutex_lock(&writer->mutex); }
+
+void writer_unlock(struct Writer *writer) { pthread_mutex_unlock(&writer->mutex); }
+
+int writer_flush(struct Writer *writer) {
+  size_t done = 0;
+  while (done < writer->len) {
+    ssize_t written = write(writer->fd, writer->buf + done, writer->len - done);
+    if (written == -1) {
+      return 1;
+    }
+
+    done += (size_t)written;
+  }
+
+  writer->len = 0;
+  return 0;
+}
+
+int writer_write(struct Writer *writer, const char *data, size_t len) {
+  while (len > 0) {
+    if (writer->len == WRITER_BUFFER_SIZE && writer_flush(writer) != 0) {
+      return 1;
+    }
+
+    size_t chunk = WRITER_BUFFER_SIZE - writer->len;
+    if (chunk > len) chunk = len;
+
+    memcpy(writer->buf + writer->len, data, chunk);
+    writer->len += chunk;
+    data += chunk;
+    len -= chunk;
+  }
+
+  return 0;
+}
+
+int writer_print_str(struct Writer *writer, const char *str) { return writer_write(writer, str, strlen(str)); }
+
+int writer_print_uint(struct Writer *writer, unsigned int value) {
+  char buffer[16];
+  size_t i = sizeof(buffer);
+
+  do {
+    buffer[--i] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+
+  return writer_write(writer, buffer + i, sizeof(buffer) - i);
+}
@@ -0,0 +1,61 @@
+#ifndef EMS_WRITER_H
+#define EMS_WRITER_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "constants.h"
+
+/// Buffered output sink of a job, written to its file descriptor in blocks of WRITER_BUFFER_SIZE bytes.
+/// @note When several threads share a writer, each must hold the writer lock while it writes, which also keeps the
+/// output of a whole command together.
+struct Writer {
+  int fd;
+  size_t len;  /// Number of bytes waiting in buf.
+  pthread_mutex_t mutex;
+  char buf[WRITER_BUFFER_SIZE];
+};
+
+/// Initializes a writer.
+/// @param writer Writer to initialize.
+/// @param fd File descriptor to write to.
+/// @return 0 if the writer was initialized successfully, 1 otherwise.
+int writer_init(struct Writer *writer, int fd);
+
+/// Destroys a writer. Does not flush it nor close its file descriptor.
+/// @param writer Writer to destroy.
+void writer_destroy(struct Writer *writer);
+
+/// Acquires exclusive use of a writer.
+/// @param writer Writer to lock.
+void writer_lock(struct Writer *writer);
+
+/// Releases a writer acquired with writer_lock.
+/// @param writer Writer to unlock.
+void writer_unlock(struct Writer *writer);
+
+/// Appends bytes to a writer, writing the buffer out whenever it fills up.
+/// @param writer Writer to append to.
+/// @param data Bytes to append.
+/// @param len Number of bytes to append.
+/// @return 0 if the bytes were appended successfully, 1 otherwise.
+int writer_write(struct Writer *writer, const char *data, size_t len);
+
+/// Appends a string to a writer.
+/// @param writer Writer to append to.
+/// @param str String to append.
+/// @return 0 if the string was appended successfully, 1 otherwise.
+int writer_print_str(struct Writer *writer, const char *str);
+
+/// Appends an unsigned integer, in decimal, to a writer.
+/// @param writer Writer to append to.
+/// @param value Value to append.
+/// @return 0 if the value was appended successfully, 1 otherwise.
+int writer_print_uint(struct Writer *writer, unsigned int value);
+
+/// Writes out every buffered byte.
+/// @param writer Writer to flush.
+/// @return 0 if the buffer was written successfully, 1 otherwise.
+int writer_flush(struct Writer *writer);
+
+#endif  // EMS_WRITER_H
@@ -0,0 +1,265 @@
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+
+/// Shape of the generated .jobs files.
+struct JobsConfig {
+  const char* out_dir;
+  unsigned int files;           /// Number of .jobs files.
+  unsigned long commands;       /// Commands per file, after the CREATEs.
+  unsigned int events;          /// Events created at the top of every file.
+  size_t rows;                  /// Rows of every event.
+  size_t cols;                  /// Columns of every event.
+  double skew;                  /// Zipf exponent of the event popularity, 0 for uniform.
+  unsigned int max_seats;       /// Largest RESERVE, at most MAX_RESERVATION_SIZE.
+  unsigned int write_pct;       /// Percentage of RESERVE commands.
+  unsigned int list_pct;        /// Percentage of LIST commands; the rest are SHOW.
+  unsigned int conflict_pct;    /// Percentage of RESERVEs aimed at seats that are already taken.
+  unsigned long barrier_every;  /// Commands between BARRIERs, 0 for none.
+  unsigned int wait_pct;        /// Percentage of WAIT commands.
+  unsigned int wait_ms;         /// Delay of every WAIT.
+  uint64_t seed;
+};
+
+/// xorshift64* generator, so that a seed gives the same files on every platform.
+static uint64_t next_random(uint64_t* state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+/// Draws an integer uniformly from [0, bound).
+static uint64_t random_below(uint64_t* state, uint64_t bound) { return next_random(state) % bound; }
+
+/// Builds the cumulative distribution of a Zipf law over the events.
+/// @param events Number of events.
+/// @param skew Zipf exponent, 0 for uniform.
+/// @return Array with the probability of picking an event with index <= i, NULL on failure.
+static double* zipf_cdf(unsigned int events, double skew) {
+  double* cdf = malloc(events * sizeof(double));
+  if (cdf == NULL) return NULL;
+
+  double total = 0.0;
+  for (unsigned int e = 0; e < events; e++) {
+    total += 1.0 / pow((double)(e + 1), skew);
+    cdf[e] = total;
+  }
+  for (unsigned int e = 0; e < events; e++) cdf[e] /= total;
+
+  return cdf;
+}
+
+/// Picks an event following the popularity distribution.
+/// @return Event id, starting at 1.
+static unsigned int pick_event(uint64_t* state, const double* cdf, unsigned int events) {
+  double u = (double)(next_random(state) >> 11) / 9007199254740992.0;  // [0, 1) with 53 bits
+
+  unsigned int lo = 0, hi = events - 1;
+  while (lo < hi) {
+    unsigned int mid = lo + (hi - lo) / 2;
+    if (cdf[mid] < u) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo + 1;
+}
+
+/// Writes one .jobs file.
+/// @note Non-conflicting RESERVEs fill each event in row-major order and only collide once it is full; conflicting
+/// ones take seats from the start of the event, which the first RESERVE of the event already holds.
+/// @return 0 if the file was written successfully, 1 otherwise.
+static int write_jobs_file(const struct JobsConfig* config, const double* cdf, unsigned int file) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%04u.jobs", config->out_dir, file);
+
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    perror(path);
+    return 1;
+  }
+
+  size_t* next_seat = calloc(config->events, sizeof(size_t));
+  if (next_seat == NULL) {
+    fclose(out);
+    return 1;
+  }
+
+  uint64_t state = config->seed * 0x9E3779B97F4A7C15ULL + file + 1;
+  size_t seats = config->rows * config->cols;
+
+  for (unsigned int e = 1; e <= config->events; e++) {
+    fprintf(out, "CREATE %u %zu %zu\n", e, config->rows, config->cols);
+  }
+  // With several threads per file, no RESERVE may run before the CREATE of its event
+  fprintf(out, "BARRIER\n");
+
+  for (unsigned long c = 0; c < config->commands; c++) {
+    if (config->barrier_every > 0 && c > 0 && c % config->barrier_every == 0) {
+      fprintf(out, "BARRIER\n");
+    }
+
+    unsigned int roll = (unsigned int)random_below(&state, 100);
+    unsigned int event_id = pick_event(&state, cdf, config->events);
+
+    if (roll < config->wait_pct) {
+      fprintf(out, "WAIT %u\n", config->wait_ms);
+    } else if (roll < config->wait_pct + config->write_pct) {
+      unsigned int num_seats = 1 + (unsigned int)random_below(&state, config->max_seats);
+      int conflict = random_below(&state, 100) < config->conflict_pct;
+
+      fprintf(out, "RESERVE %u [", event_id);
+      for (unsigned int s = 0; s < num_seats; s++) {
+        size_t seat = conflict ? s % seats : next_seat[event_id - 1]++ % seats;
+        fprintf(out, "%s(%zu,%zu)", s == 0 ? "" : " ", seat / config->cols + 1, seat % config->cols + 1);
+      }
+      fprintf(out, "]\n");
+    } else if (roll < config->wait_pct + config->write_pct + config->list_pct) {
+      fprintf(out, "LIST\n");
+    } else {
+      fprintf(out, "SHOW %u\n", event_id);
+    }
+  }
+
+  free(next_seat);
+  if (fclose(out) != 0) {
+    perror(path);
+    return 1;
+  }
+
+  return 0;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-f files] [-n commands] [-e events] [-r rows] [-k cols] [-z zipf] [-m max seats] [-w write%%]\n"
+          "          [-l list%%] [-x conflict%%] [-b barrier every] [-t wait%%] [-d wait ms] [-S seed] <output dir>\n",
+          prog);
+}
+
+/// Parses a numeric option.
+/// @return 0 if the value is valid, 1 otherwise.
+static int parse_option(const char* arg, unsigned long min, unsigned long max, unsigned long* value) {
+  char* endptr;
+  *value = strtoul(arg, &endptr, 10);
+  return *endptr != '\0' || endptr == arg || *value < min || *value > max;
+}
+
+int main(int argc, char* argv[]) {
+  struct JobsConfig config = {.files = 1,
+                              .commands = 1000,
+                              .events = 10,
+                              .rows = 10,
+                              .cols = 10,
+                              .skew = 0.0,
+                              .max_seats = 4,
+                              .write_pct = 50,
+                              .list_pct = 5,
+                              .conflict_pct = 10,
+                              .barrier_every = 0,
+                              .wait_pct = 0,
+                              .wait_ms = 0,
+                              .seed = 1};
+
+  int opt;
+  unsigned long value;
+  while ((opt = getopt(argc, argv, "f:n:e:r:k:z:m:w:l:x:b:t:d:S:")) != -1) {
+    int invalid = 0;
+    char* endptr;
+    switch (opt) {
+      case 'f':
+        invalid = parse_option(optarg, 1, 9999, &value);
+        config.files = (unsigned int)value;
+        break;
+      case 'n':
+        invalid = parse_option(optarg, 0, ULONG_MAX, &value);
+        config.commands = value;
+        break;
+      case 'e':
+        invalid = parse_option(optarg, 1, 10000000, &value);
+        config.events = (unsigned int)value;
+        break;
+      case 'r':
+        invalid = parse_option(optarg, 1, 100000, &value);
+        config.rows = value;
+        break;
+      case 'k':
+        invalid = parse_option(optarg, 1, 100000, &value);
+        config.cols = value;
+        break;
+      case 'z':
+        config.skew = strtod(optarg, &endptr);
+        invalid = *endptr != '\0' || endptr == optarg || config.skew < 0.0;
+        break;
+      case 'm':
+        invalid = parse_option(optarg, 1, MAX_RESERVATION_SIZE, &value);
+        config.max_seats = (unsigned int)value;
+        break;
+      case 'w':
+        invalid = parse_option(optarg, 0, 100, &value);
+        config.write_pct = (unsigned int)value;
+        break;
+      case 'l':
+        invalid = parse_option(optarg, 0, 100, &value);
+        config.list_pct = (unsigned int)value;
+        break;
+      case 'x':
+        invalid = parse_option(optarg, 0, 100, &value);
+        config.conflict_pct = (unsigned int)value;
+        break;
+      case 'b':
+        invalid = parse_option(optarg, 0, ULONG_MAX, &value);
+        config.barrier_every = value;
+        break;
+      case 't':
+        invalid = parse_option(optarg, 0, 100, &value);
+        config.wait_pct = (unsigned int)value;
+        break;
+      case 'd':
+        invalid = parse_option(optarg, 0, UINT32_MAX, &value);
+        config.wait_ms = (unsigned int)value;
+        break;
+      case 'S':
+        invalid = parse_option(optarg, 0, ULONG_MAX, &value);
+        config.seed = value;
+        break;
+      default:
+        invalid = 1;
+        break;
+    }
+
+    if (invalid) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc - optind != 1 || config.write_pct + config.list_pct + config.wait_pct > 100) {
+    usage(argv[0]);
+    return 1;
+  }
+  config.out_dir = argv[optind];
+
+  double* cdf = zipf_cdf(config.events, config.skew);
+  if (cdf == NULL) {
+    fprintf(stderr, "Error allocating memory for the event distribution\n");
+    return 1;
+  }
+
+  int ret = 0;
+  for (unsigned int f = 0; f < config.files && ret == 0; f++) {
+    ret = write_jobs_file(&config, cdf, f);
+  }
+
+  free(cdf);
+  return ret;
+}
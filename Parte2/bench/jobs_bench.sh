@@ -0,0 +1,63 @@
+#!/bin/sh
+# Times "Código Base/ems" and the Parte2 server over the same generated .jobs files.
+# Usage: bench/jobs_bench.sh [-p max_proc] [-t threads] [-a async_threads] [-- <bench/jobgen options>]
+#   -p  MAX_PROC given to Código Base (default 4)
+#   -t  MAX_THREADS given to Código Base, which then runs the files as threads of one process
+#   -a  run the Parte2 server in async mode with this many executor threads
+# Both run without state access delay, so the numbers measure the implementation and not the simulated storage.
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+CB="$ROOT/../Código Base"
+
+max_proc=4
+threads=""
+async=""
+while getopts "p:t:a:" opt; do
+  case $opt in
+    p) max_proc=$OPTARG ;;
+    t) threads=$OPTARG ;;
+    a) async="-a $OPTARG" ;;
+    *) sed -n '3,6p' "$0" >&2; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+make -s -C "$ROOT" all bench
+make -s -C "$CB" ems
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+mkdir "$WORK/jobs" "$WORK/p2"
+"$ROOT/bench/jobgen" "$@" "$WORK/jobs"
+cp "$WORK"/jobs/*.jobs "$WORK/p2/"
+files=$(ls "$WORK"/jobs/*.jobs | wc -l)
+commands=$(cat "$WORK"/jobs/*.jobs | wc -l)
+
+now_ms() { echo $(($(date +%s%N) / 1000000)); }
+
+# Código Base: "ems jobs <MAX_PROC> [MAX_THREADS]" with delay 0, exiting when stdin ends
+start=$(now_ms)
+(cd "$WORK" && "$CB/ems" jobs "$max_proc" $threads < /dev/null > /dev/null 2>&1)
+cb_ms=$(($(now_ms) - start))
+
+# Parte2: one client per file against a fresh server
+"$ROOT/server/ems" $async "$WORK/srv" 0 > /dev/null 2>&1 &
+server=$!
+while [ ! -p "$WORK/srv" ]; do sleep 0.05; done
+
+start=$(now_ms)
+i=0
+clients=""
+for f in "$WORK"/p2/*.jobs; do
+  "$ROOT/client/client" "$WORK/q$i" "$WORK/r$i" "$WORK/srv" "$f" > /dev/null 2>&1 &
+  clients="$clients $!"
+  i=$((i + 1))
+done
+for pid in $clients; do
+  wait "$pid" || true
+done
+p2_ms=$(($(now_ms) - start))
+kill "$server"
+
+echo "files=$files commands=$commands codigo_base_ms=$cb_ms parte2_ms=$p2_ms"
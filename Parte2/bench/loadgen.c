@@ -0,0 +1,270 @@
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client/api.h"
+#include "common/constants.h"
+
+/// Workload of a benchmark run.
+struct LoadConfig {
+  const char* server_pipe;
+  unsigned int sessions;      /// Client processes, one session each.
+  unsigned int ops;           /// Requests per session.
+  unsigned int events;        /// Events created before the run.
+  size_t rows;                /// Rows of every event.
+  size_t cols;                /// Columns of every event.
+  unsigned int write_pct;     /// Percentage of RESERVE requests; the rest are SHOW.
+  unsigned int conflict_pct;  /// Percentage of RESERVE requests aimed at a seat that is already taken.
+  unsigned int seats_per_op;  /// Seats per reservation.
+  unsigned int groups;        /// Reservations per RESERVE, sent as one RESERVE_MULTI when more than 1.
+  int priority;               /// Whether the sessions ask for the PRIORITY class.
+  unsigned int seed;
+};
+
+/// Results shared by the client processes with the parent.
+struct LoadResults {
+  uint32_t* latencies_us;  /// ops latencies per session, in session order.
+  uint64_t* failed;        /// Requests refused or lost per session, not counting the conflicting RESERVEs.
+};
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-c sessions] [-n ops] [-e events] [-r rows] [-k cols] [-w write%%] [-x conflict%%] [-m seats]\n"
+          "          [-g groups] [-P] [-S seed] <server pipe path>\n",
+          prog);
+}
+
+/// Parses a numeric option.
+/// @param arg Text of the option.
+/// @param min Smallest accepted value.
+/// @param max Largest accepted value.
+/// @param value Pointer to store the value in.
+/// @return 0 if the value is valid, 1 otherwise.
+static int parse_option(const char* arg, unsigned long min, unsigned long max, unsigned long* value) {
+  char* endptr;
+  *value = strtoul(arg, &endptr, 10);
+  return *endptr != '\0' || endptr == arg || *value < min || *value > max;
+}
+
+/// Connects a session with pipes named after the process and the session.
+/// @param config Workload of the run.
+/// @param session Index of the session.
+/// @return 0 if the session was set up, 1 otherwise.
+static int connect_bench_session(const struct LoadConfig* config, unsigned int session) {
+  char req_path[MAX_PATH_SIZE], resp_path[MAX_PATH_SIZE];
+  snprintf(req_path, sizeof(req_path), "/tmp/emsb.%d.%u.req", (int)getpid(), session);
+  snprintf(resp_path, sizeof(resp_path), "/tmp/emsb.%d.%u.resp", (int)getpid(), session);
+  ems_set_session_class(config->priority ? SESSION_CLASS_PRIORITY : SESSION_CLASS_NORMAL);
+  return ems_setup(req_path, resp_path, config->server_pipe);
+}
+
+/// Runs the requests of one session.
+/// @note A conflicting RESERVE targets the first seats of the event, which the first one to get there takes. The other
+/// seats of each event are handed out round-robin between sessions, so the remaining RESERVEs only fail once the
+/// event is full.
+/// @param config Workload of the run.
+/// @param session Index of the session.
+/// @param results Shared results to record the latencies in.
+static void run_session(const struct LoadConfig* config, unsigned int session, struct LoadResults* results) {
+  uint32_t* latencies = &results->latencies_us[(size_t)session * config->ops];
+  unsigned int rand_state = config->seed * 7919u + session;
+
+  if (connect_bench_session(config, session) != 0) {
+    results->failed[session] = config->ops;
+    return;
+  }
+
+  int devnull = open("/dev/null", O_WRONLY);
+  size_t seats = config->rows * config->cols;
+  size_t* next_seat = malloc(config->events * sizeof(size_t));  // Next seat of the session in each event
+  if (devnull < 0 || next_seat == NULL) {
+    results->failed[session] = config->ops;
+    free(next_seat);
+    ems_quit();
+    return;
+  }
+  for (unsigned int e = 0; e < config->events; e++) next_seat[e] = session;
+
+  for (unsigned int op = 0; op < config->ops; op++) {
+    unsigned int event_id = 1 + (unsigned int)rand_r(&rand_state) % config->events;
+    int is_write = (unsigned int)rand_r(&rand_state) % 100 < config->write_pct;
+    int conflict = (unsigned int)rand_r(&rand_state) % 100 < config->conflict_pct;
+
+    size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE], sizes[MAX_RESERVATION_GROUPS];
+    size_t num_seats = is_write ? (size_t)config->groups * config->seats_per_op : 0;
+    for (size_t s = 0; s < num_seats; s++) {
+      size_t* next = &next_seat[event_id - 1];
+      size_t seat = conflict ? s % config->seats_per_op : config->seats_per_op + *next % (seats - config->seats_per_op);
+      if (!conflict) *next += config->sessions;
+      xs[s] = seat / config->cols + 1;
+      ys[s] = seat % config->cols + 1;
+    }
+    for (unsigned int g = 0; g < config->groups; g++) sizes[g] = config->seats_per_op;
+
+    uint64_t start = now_us();
+    int group_results[MAX_RESERVATION_GROUPS];
+    int ret = !is_write              ? ems_show(devnull, event_id)
+              : config->groups == 1 ? ems_reserve(event_id, num_seats, xs, ys)
+                                    : ems_reserve_multi(event_id, config->groups, sizes, xs, ys, group_results);
+    uint64_t elapsed = now_us() - start;
+
+    latencies[op] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+    // A conflicting reservation is expected to be refused
+    if (ret != 0 && !(is_write && conflict)) results->failed[session]++;
+  }
+
+  free(next_seat);
+  close(devnull);
+  ems_quit();
+}
+
+static int compare_u32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char* argv[]) {
+  struct LoadConfig config = {.sessions = 4,
+                              .ops = 1000,
+                              .events = 8,
+                              .rows = 10,
+                              .cols = 10,
+                              .write_pct = 50,
+                              .conflict_pct = 10,
+                              .seats_per_op = 1,
+                              .groups = 1,
+                              .seed = 1};
+
+  int opt;
+  unsigned long value;
+  while ((opt = getopt(argc, argv, "c:n:e:r:k:w:x:m:g:PS:")) != -1) {
+    int invalid = 0;
+    switch (opt) {
+      case 'c':
+        invalid = parse_option(optarg, 1, 1024, &value);
+        config.sessions = (unsigned int)value;
+        break;
+      case 'n':
+        invalid = parse_option(optarg, 1, 10000000, &value);
+        config.ops = (unsigned int)value;
+        break;
+      case 'e':
+        invalid = parse_option(optarg, 1, 1000000, &value);
+        config.events = (unsigned int)value;
+        break;
+      case 'r':
+        invalid = parse_option(optarg, 1, 10000, &value);
+        config.rows = value;
+        break;
+      case 'k':
+        invalid = parse_option(optarg, 1, 10000, &value);
+        config.cols = value;
+        break;
+      case 'w':
+        invalid = parse_option(optarg, 0, 100, &value);
+        config.write_pct = (unsigned int)value;
+        break;
+      case 'x':
+        invalid = parse_option(optarg, 0, 100, &value);
+        config.conflict_pct = (unsigned int)value;
+        break;
+      case 'm':
+        invalid = parse_option(optarg, 1, MAX_RESERVATION_SIZE, &value);
+        config.seats_per_op = (unsigned int)value;
+        break;
+      case 'g':
+        invalid = parse_option(optarg, 1, MAX_RESERVATION_GROUPS, &value);
+        config.groups = (unsigned int)value;
+        break;
+      case 'P':
+        config.priority = 1;
+        break;
+      case 'S':
+        invalid = parse_option(optarg, 0, UINT32_MAX, &value);
+        config.seed = (unsigned int)value;
+        break;
+      default:
+        invalid = 1;
+        break;
+    }
+
+    if (invalid) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc - optind != 1 || config.seats_per_op >= config.rows * config.cols ||
+      config.groups * config.seats_per_op > MAX_RESERVATION_SIZE) {
+    usage(argv[0]);
+    return 1;
+  }
+  config.server_pipe = argv[optind];
+
+  // Events are created by a setup session before the clients start, so that every request finds its event
+  if (connect_bench_session(&config, config.sessions) != 0) {
+    fprintf(stderr, "Failed to connect to the server\n");
+    return 1;
+  }
+  for (unsigned int e = 1; e <= config.events; e++) {
+    if (ems_create(e, config.rows, config.cols) != 0) {
+      fprintf(stderr, "Failed to create event %u (was the server restarted?)\n", e);
+    }
+  }
+  ems_quit();
+
+  size_t total_ops = (size_t)config.sessions * config.ops;
+  size_t size = total_ops * sizeof(uint32_t) + config.sessions * sizeof(uint64_t);
+  void* shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  struct LoadResults results = {.failed = shared, .latencies_us = (uint32_t*)((uint64_t*)shared + config.sessions)};
+
+  uint64_t start = now_us();
+  for (unsigned int s = 0; s < config.sessions; s++) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      run_session(&config, s, &results);
+      _exit(0);
+    }
+  }
+  while (wait(NULL) > 0) {
+  }
+  uint64_t elapsed = now_us() - start;
+
+  uint64_t failed = 0;
+  for (unsigned int s = 0; s < config.sessions; s++) failed += results.failed[s];
+  qsort(results.latencies_us, total_ops, sizeof(uint32_t), compare_u32);
+
+  double ops_per_sec = elapsed > 0 ? (double)total_ops * 1e6 / (double)elapsed : 0.0;
+  printf("sessions=%u ops=%zu events=%u size=%zux%zu write=%u%% conflict=%u%% seats=%u groups=%u class=%s seed=%u\n",
+         config.sessions, total_ops, config.events, config.rows, config.cols, config.write_pct, config.conflict_pct,
+         config.seats_per_op, config.groups, config.priority ? "priority" : "normal", config.seed);
+  printf("elapsed_ms=%lu ops_per_sec=%.1f p50_us=%u p99_us=%u p999_us=%u max_us=%u failed=%lu\n",
+         (unsigned long)(elapsed / 1000), ops_per_sec, results.latencies_us[total_ops * 500 / 1000],
+         results.latencies_us[total_ops * 990 / 1000], results.latencies_us[total_ops * 999 / 1000],
+         results.latencies_us[total_ops - 1], (unsigned long)failed);
+
+  munmap(shared, size);
+  return 0;
+}
@@ -0,0 +1,291 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/io.h"
+#include "server/buffer.h"
+#include "server/eventlist.h"
+#include "server/operations.h"
+
+#define MICRO_REPEATS 5     // Timed runs per benchmark; the median is reported
+#define MICRO_EVENTS 1000   // Events in the list searched by get_event
+#define MICRO_SEED 42       // Seed of the lookups, fixed so that runs are comparable
+#define MICRO_ROWS 100      // Size of the event used by ems_reserve and ems_show
+#define MICRO_COLS 100
+#define MICRO_SEATS 16  // Seats of the conflicting reservation
+
+/// A microbenchmark: setup and teardown are not timed, run performs the operation iterations times.
+struct MicroBench {
+  const char* name;
+  size_t iterations;
+  void (*setup)(size_t iterations);
+  void (*run)(size_t iterations);
+  void (*teardown)(void);
+};
+
+static int devnull = -1;
+static volatile uintptr_t sink;  // Keeps the results of the operations alive
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/// Reads the cycle counter.
+/// @return Cycles since an arbitrary point, 0 where there is no cycle counter.
+static uint64_t now_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static uint64_t next_random(uint64_t* state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+// ---------------------------------------- get_event / append_to_list ----------------------------------------
+
+static struct EventList* list = NULL;
+static unsigned int* lookups = NULL;
+
+/// Creates a list of count events without seats.
+static void fill_list(size_t count) {
+  list = create_list();
+  for (size_t i = 0; i < count; i++) append_to_list(list, (unsigned int)i + 1, 0, 0, NULL);
+}
+
+static void setup_get_event(size_t iterations) {
+  fill_list(MICRO_EVENTS);
+
+  uint64_t state = MICRO_SEED;
+  lookups = malloc(iterations * sizeof(unsigned int));
+  for (size_t i = 0; i < iterations; i++) lookups[i] = 1 + (unsigned int)(next_random(&state) % MICRO_EVENTS);
+}
+
+static void run_get_event(size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) sink = (uintptr_t)get_event(list, lookups[i]);
+}
+
+static void teardown_get_event(void) {
+  free_list(list);
+  list = NULL;
+  free(lookups);
+}
+
+static void setup_append(size_t iterations) { (void)iterations; }
+
+static void run_append(size_t iterations) {
+  free_list(list);  // Left over from the warm-up or the previous run
+  fill_list(iterations);
+}
+
+static void teardown_append(void) {
+  free_list(list);
+  list = NULL;
+}
+
+// ---------------------------------------- ems_reserve / ems_show ----------------------------------------
+
+static size_t conflict_xs[MICRO_SEATS], conflict_ys[MICRO_SEATS];
+static struct Buffer rendered;
+
+/// Creates the event used by ems_reserve and ems_show, once, with its last row taken.
+static void setup_event(size_t iterations) {
+  (void)iterations;
+  static int created = 0;
+  if (created) return;
+  created = 1;
+
+  ems_create(1, MICRO_ROWS, MICRO_COLS);
+  size_t xs[MICRO_COLS], ys[MICRO_COLS];
+  for (size_t c = 0; c < MICRO_COLS; c++) {
+    xs[c] = MICRO_ROWS;
+    ys[c] = c + 1;
+  }
+  ems_reserve(1, MICRO_COLS, xs, ys);
+
+  // Free seats scattered over the event, then a taken one: every seat is checked before the reservation fails
+  for (size_t s = 0; s < MICRO_SEATS; s++) {
+    conflict_xs[s] = 1 + s * (MICRO_ROWS - 1) / MICRO_SEATS;
+    conflict_ys[s] = 1 + s % MICRO_COLS;
+  }
+  conflict_xs[MICRO_SEATS - 1] = MICRO_ROWS;
+  conflict_ys[MICRO_SEATS - 1] = MICRO_COLS;
+}
+
+static void run_reserve_conflict(size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) sink = (uintptr_t)ems_reserve(1, MICRO_SEATS, conflict_xs, conflict_ys);
+}
+
+static void run_show(size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) {
+    size_t rows, cols, position = 0;
+    unsigned int* seats;
+    rendered.len = 0;
+    if (ems_show(1, &rows, &cols, &seats) == 0) {
+      sink = (uintptr_t)ems_print_seats(&rendered, seats, cols, &position, rows * cols, SIZE_MAX);
+      free(seats);
+    }
+  }
+}
+
+static void teardown_nothing(void) {}
+
+static void teardown_show(void) { buffer_free(&rendered); }
+
+// ---------------------------------------- parse_uint / print_uint / print_str ----------------------------------------
+
+static int numbers_fd = -1;
+
+static void setup_parse_uint(size_t iterations) {
+  char path[] = "/tmp/ems_micro_XXXXXX";
+  numbers_fd = mkstemp(path);
+  unlink(path);
+
+  uint64_t state = MICRO_SEED;
+  for (size_t i = 0; i < iterations; i++) {
+    char line[16];
+    snprintf(line, sizeof(line), "%u\n", (unsigned int)(next_random(&state) % 1000000));
+    print_str(numbers_fd, line);
+  }
+}
+
+static void run_parse_uint(size_t iterations) {
+  lseek(numbers_fd, 0, SEEK_SET);
+  for (size_t i = 0; i < iterations; i++) {
+    unsigned int value;
+    char next;
+    parse_uint(numbers_fd, &value, &next);
+    sink = value;
+  }
+}
+
+static void teardown_parse_uint(void) { close(numbers_fd); }
+
+static void setup_nothing(size_t iterations) { (void)iterations; }
+
+static void run_print_uint(size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) print_uint(devnull, (unsigned int)i * 2654435761u);
+}
+
+static void run_print_str(size_t iterations) {
+  for (size_t i = 0; i < iterations; i++) print_str(devnull, "Event: ");
+}
+
+static const struct MicroBench benches[] = {
+    {"get_event", 200000, setup_get_event, run_get_event, teardown_get_event},
+    {"append_to_list", 1000000, setup_append, run_append, teardown_append},
+    {"ems_reserve_conflict", 2000, setup_event, run_reserve_conflict, teardown_nothing},
+    {"ems_show", 2000, setup_event, run_show, teardown_show},
+    {"parse_uint", 200000, setup_parse_uint, run_parse_uint, teardown_parse_uint},
+    {"print_uint", 1000000, setup_nothing, run_print_uint, teardown_nothing},
+    {"print_str", 1000000, setup_nothing, run_print_str, teardown_nothing},
+};
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/// Looks up the time of a benchmark in a baseline written by a previous run.
+/// @return Nanoseconds per operation, 0 if the benchmark is not in the baseline.
+static double baseline_ns(FILE* baseline, const char* name) {
+  if (baseline == NULL) return 0.0;
+
+  rewind(baseline);
+  char line[256];
+  while (fgets(line, sizeof(line), baseline) != NULL) {
+    char bench[128];
+    double ns;
+    if (sscanf(line, "%127s %lf", bench, &ns) == 2 && strcmp(bench, name) == 0) return ns;
+  }
+
+  return 0.0;
+}
+
+int main(int argc, char* argv[]) {
+  FILE* baseline = NULL;
+  unsigned long tolerance_pct = 10;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:t:")) != -1) {
+    switch (opt) {
+      case 'b':
+        baseline = fopen(optarg, "r");
+        if (baseline == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 't':
+        tolerance_pct = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-b baseline] [-t tolerance%%]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  devnull = open("/dev/null", O_WRONLY);
+  if (devnull < 0 || ems_init(0)) {
+    fprintf(stderr, "Failed to initialize the benchmarks\n");
+    return 1;
+  }
+
+  // The failing reservations report on stderr; only the results are wanted
+  int report_fd = dup(STDERR_FILENO);
+  dup2(devnull, STDERR_FILENO);
+  buffer_init(&rendered);
+
+  int regressions = 0;
+  printf("%-22s %12s %12s %10s\n", "# benchmark", "ns/op", "cycles/op", "baseline");
+
+  for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+    const struct MicroBench* bench = &benches[b];
+    bench->setup(bench->iterations);
+    bench->run(bench->iterations / 10 + 1);  // Warm-up: caches, branch predictors and allocator
+
+    uint64_t ns[MICRO_REPEATS], cycles[MICRO_REPEATS];
+    for (size_t r = 0; r < MICRO_REPEATS; r++) {
+      uint64_t start_ns = now_ns(), start_cycles = now_cycles();
+      bench->run(bench->iterations);
+      cycles[r] = now_cycles() - start_cycles;
+      ns[r] = now_ns() - start_ns;
+    }
+    bench->teardown();
+
+    qsort(ns, MICRO_REPEATS, sizeof(uint64_t), compare_u64);
+    qsort(cycles, MICRO_REPEATS, sizeof(uint64_t), compare_u64);
+    double ns_per_op = (double)ns[MICRO_REPEATS / 2] / (double)bench->iterations;
+    double cycles_per_op = (double)cycles[MICRO_REPEATS / 2] / (double)bench->iterations;
+
+    double reference = baseline_ns(baseline, bench->name);
+    int regressed = reference > 0.0 && ns_per_op > reference * (1.0 + (double)tolerance_pct / 100.0);
+    regressions += regressed;
+
+    printf("%-22s %12.1f %12.1f", bench->name, ns_per_op, cycles_per_op);
+    if (reference > 0.0) printf(" %10.1f%s", reference, regressed ? "  REGRESSION" : "");
+    printf("\n");
+  }
+
+  fflush(stdout);
+  dup2(report_fd, STDERR_FILENO);
+  close(report_fd);
+  close(devnull);
+  if (regressions > 0) {
+    fprintf(stderr, "%d benchmark(s) more than %lu%% slower than the baseline\n", regressions, tolerance_pct);
+  }
+
+  if (baseline != NULL) fclose(baseline);
+  return regressions > 0;
+}
@@ -0,0 +1,161 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "common/io.h"
+#include "common/protocol.h"
+#include "server/buffer.h"
+#include "server/operations.h"
+#include "server/requests.h"
+#include "server/stats.h"
+#include "server/trace.h"
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/// Sleeps until a point in time.
+/// @param deadline_us Time to wake up at, as returned by now_us.
+static void sleep_until(uint64_t deadline_us) {
+  uint64_t now = now_us();
+  if (deadline_us <= now) return;
+
+  uint64_t wait = deadline_us - now;
+  struct timespec delay = {(time_t)(wait / 1000000), (long)(wait % 1000000) * 1000};
+  nanosleep(&delay, NULL);
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [-f] [-d delay] [-o replies] <trace>\n", prog);
+}
+
+/// Replays a trace recorded by the server with -r, through the same dispatch as the session workers.
+/// @note Requests are replayed one at a time in the order they were received, so that every run over a trace does the
+/// same operations in the same order and builds the same replies; -o writes them to a file to be compared.
+int main(int argc, char* argv[]) {
+  int fast = 0;                // As fast as possible instead of at the recorded pace
+  unsigned long delay_us = 0;  // State access delay of the replayed server
+  const char* replies_path = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "fd:o:")) != -1) {
+    char* endptr;
+    switch (opt) {
+      case 'f':
+        fast = 1;
+        break;
+      case 'd':
+        delay_us = strtoul(optarg, &endptr, 10);
+        if (*endptr != '\0' || endptr == optarg || delay_us > UINT32_MAX) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'o':
+        replies_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (argc - optind != 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  FILE* trace = trace_reader_open(argv[optind]);
+  if (trace == NULL) {
+    return 1;
+  }
+
+  int replies_fd = -1;
+  if (replies_path != NULL && (replies_fd = open(replies_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    perror(replies_path);
+    fclose(trace);
+    return 1;
+  }
+
+  if (ems_init((unsigned int)delay_us)) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    fclose(trace);
+    return 1;
+  }
+
+  struct TraceRecord* record = malloc(sizeof(struct TraceRecord));
+  if (record == NULL) {
+    fprintf(stderr, "Error allocating memory for the trace record\n");
+    fclose(trace);
+    return 1;
+  }
+
+  unsigned long requests = 0, failed = 0;
+  int ret;
+  uint64_t start = now_us();
+
+  while ((ret = trace_read(trace, record)) == 0) {
+    if (!fast) sleep_until(start + record->time_us);
+
+    uint64_t started = stats_begin();
+    requests++;
+
+    // SETUPs are recorded as the server pipe gets them, so they are the only records parse_setup accepts
+    char setup[TAMMSG], req_pipe_path[PATH_MAX], resp_pipe_path[PATH_MAX];
+    enum SessionClass session_class;
+    memcpy(setup, record->msg, TAMMSG);
+    if (parse_setup(setup, req_pipe_path, resp_pipe_path, &session_class) == 0) {
+      store_session_details(record->session_id, req_pipe_path, resp_pipe_path);
+      stats_end(STATS_OP_SETUP, started);
+      continue;
+    }
+
+    struct Buffer reply;
+    struct ReplyStream stream;
+    buffer_init(&reply);
+    stream_init(&stream);
+    enum StatsOp stats_op;
+    int request_failed = dispatch_request(record->msg, &reply, &stream, &stats_op);
+    while (1) {
+      if (!request_failed && replies_fd >= 0 && reply.len > 0 && write_all(replies_fd, reply.data, reply.len)) {
+        perror(replies_path);
+        replies_fd = -1;
+      }
+      if (request_failed || !stream.pending) break;
+
+      reply.len = 0;
+      request_failed = stream_next(&stream, &reply);
+    }
+    if (request_failed) failed++;
+    stream_free(&stream);
+    buffer_free(&reply);
+    stats_end(stats_op, started);
+
+    if (stats_op == STATS_OP_QUIT) free_Session(record->session_id);
+  }
+  uint64_t elapsed = now_us() - start;
+
+  if (ret < 0) {
+    fprintf(stderr, "Trace truncated after %lu requests\n", requests);
+  }
+
+  double ops_per_sec = elapsed > 0 ? (double)requests * 1e6 / (double)elapsed : 0.0;
+  printf("requests=%lu elapsed_ms=%lu ops_per_sec=%.1f failed=%lu\n", requests, (unsigned long)(elapsed / 1000),
+         ops_per_sec, failed);
+  fflush(stdout);
+  stats_print(STDOUT_FILENO);
+
+  free(record);
+  fclose(trace);
+  if (replies_fd >= 0) close(replies_fd);
+  ems_terminate();
+  return 0;
+}
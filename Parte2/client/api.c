@@ -1,157 +1,587 @@
 #include "api.h"
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <errno.h>
 #include <string.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <time.h>
 #include "common/constants.h"
+#include "common/io.h"
+#include "common/protocol.h"
 
-int session_id;
-int req_pipe;
-int resp_pipe;
-int server_pipe;
-char reqst_pipe_path[MAX_PATH_SIZE];
-char respn_pipe_path[MAX_PATH_SIZE];
-
-
-void fillString(char string[], size_t size){
-  size_t len=strlen(string);
-  for (size_t i=len;i<size;i++){
-    string[i]='\0';
-  }
-}
-
-char *arrayXY(size_t *xys, size_t num_seats){
-  char lista[200]= "[";
-  char temp[3];
-  size_t i;
-  for(i=0;i< num_seats-1; i++){
-    sprintf(temp,"%ld ",xys[i]);
-    strcat(lista, temp);
-  }
-  sprintf(temp,"%ld]",xys[i+1]);
-  strcat(lista, temp);
-  char *ptr=lista;
-  return ptr;
-}
-
-void parseMsg(char buf[TAMMSG],char atribts[5][MAX_RESERVATION_SIZE]){
-    int i=0;
-    // Extract the first token
-    char * token = strtok(buf, "|");
-    strcpy(atribts[i],token);
-    i++;
-  // loop through the string to extract all other tokens
-    while( token != NULL ) {
-         //printing each token
-        token = strtok(NULL, "|");
-        if(token != NULL)
-            strcpy(atribts[i],token);
-        i++;
+/// Session with one of the servers, each owning the events with event_id % num_shards equal to its index.
+struct Shard {
+  int session_id;
+  int req_pipe;
+  int resp_pipe;
+  char reqst_pipe_path[MAX_PATH_SIZE];
+  char respn_pipe_path[MAX_PATH_SIZE];
+};
+
+static struct Shard shards[MAX_SHARDS];
+static size_t num_shards = 0;
+static enum SessionClass session_class = SESSION_CLASS_NORMAL;
+static int busy_retry_after_ms = 0;  // Hint of the last BUSY answer
+static unsigned int backoff_seed = 0;
+
+/// Gets the session with the server that owns an event.
+/// @param event_id Id of the event.
+/// @return The shard of the event.
+static struct Shard *shard_of(unsigned int event_id) { return &shards[event_id % num_shards]; }
+
+/// Formats a list of coordinates as "[<c1> <c2> ...]".
+/// @param list Buffer to store the list in.
+/// @param size Size of list.
+/// @param coords Coordinates to format.
+/// @param num_seats Number of coordinates.
+/// @return 0 if the list fits in the buffer, 1 otherwise.
+static int format_coords(char *list, size_t size, const size_t *coords, size_t num_seats) {
+  size_t len = 0;
+  for (size_t i = 0; i < num_seats; i++) {
+    int written = snprintf(list + len, size - len, "%s%zu", i == 0 ? "[" : " ", coords[i]);
+    if (written < 0 || (size_t)written >= size - len) return 1;
+    len += (size_t)written;
+  }
+
+  if (len + 2 > size) return 1;
+  strcpy(list + len, "]");
+  return 0;
+}
+
+/// Formats the rows or the columns of a list of ranges as "[<a1>-<b1> <a2> ...]".
+/// @param list Buffer to store the list in.
+/// @param size Size of list.
+/// @param ranges Ranges to format.
+/// @param num_ranges Number of ranges.
+/// @param rows Whether to format the rows, otherwise the columns.
+/// @return 0 if the list fits in the buffer, 1 otherwise.
+static int format_spans(char *list, size_t size, const struct SeatRange *ranges, size_t num_ranges, int rows) {
+  size_t len = 0;
+  for (size_t i = 0; i < num_ranges; i++) {
+    size_t first = rows ? ranges[i].first_row : ranges[i].first_col;
+    size_t last = rows ? ranges[i].last_row : ranges[i].last_col;
+    int written = first == last ? snprintf(list + len, size - len, "%s%zu", i == 0 ? "[" : " ", first)
+                                : snprintf(list + len, size - len, "%s%zu-%zu", i == 0 ? "[" : " ", first, last);
+    if (written < 0 || (size_t)written >= size - len) return 1;
+    len += (size_t)written;
+  }
+
+  if (len + 2 > size) return 1;
+  strcpy(list + len, "]");
+  return 0;
+}
+
+/// Waits before trying again after a BUSY answer, exponentially longer on each attempt.
+/// @param attempt Number of BUSY answers so far, minus one.
+/// @param retry_after_ms Wait suggested by the server, in milliseconds.
+static void backoff(unsigned int attempt, int retry_after_ms) {
+  if (backoff_seed == 0) backoff_seed = (unsigned int)getpid();
+
+  uint64_t wait_us = attempt < 20 ? (uint64_t)CLIENT_BACKOFF_MIN_US << attempt : CLIENT_BACKOFF_MAX_US;
+  if (wait_us > CLIENT_BACKOFF_MAX_US) wait_us = CLIENT_BACKOFF_MAX_US;
+
+  // Half of the wait is random, so that the clients refused together do not all come back together
+  wait_us = wait_us / 2 + (uint64_t)rand_r(&backoff_seed) % (wait_us / 2 + 1);
+  if (retry_after_ms > 0 && (uint64_t)retry_after_ms * 1000 > wait_us) wait_us = (uint64_t)retry_after_ms * 1000;
+  struct timespec delay = {(time_t)(wait_us / 1000000), (long)(wait_us % 1000000) * 1000};
+  nanosleep(&delay, NULL);
+}
+
+/// Sends a request and waits for the header of its reply, sending it again while the server answers BUSY.
+/// @param shard Session to send the request on.
+/// @param request Request to send.
+/// @param ret Pointer to store the return value of the operation in.
+/// @param size Pointer to store the size of the payload in, or its number of lines if it is streamed.
+/// @param streamed Pointer to store whether the payload is streamed in chunks.
+/// @return 0 if a header other than BUSY was received, with the payload left to be read; 1 if the server could not
+/// be reached, REPLY_BUSY if it was still overloaded after CLIENT_BUSY_RETRIES retries.
+static int exchange(struct Shard *shard, const char *request, int *ret, size_t *size, int *streamed) {
+  for (unsigned int attempt = 0;; attempt++) {
+    if (send_message(shard->req_pipe, request) || receive_reply_header(shard->resp_pipe, ret, size, streamed)) {
+      return 1;
+    }
+
+    if (*ret != REPLY_BUSY) {
+      return 0;
     }
+
+    char *payload;
+    size_t payload_len;
+    if (receive_reply_payload(shard->resp_pipe, *streamed, *size, &payload, &payload_len)) {
+      return 1;
+    }
+    busy_retry_after_ms = BUSY_RETRY_MIN_MS;
+    if (payload_len == sizeof(int)) memcpy(&busy_retry_after_ms, payload, sizeof(int));
+    free(payload);
+
+    if (attempt == CLIENT_BUSY_RETRIES) {
+      return REPLY_BUSY;
+    }
+    backoff(attempt, busy_retry_after_ms);
+  }
 }
 
-int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
-  //TODO: create pipes and connect to the server
-  unlink(req_pipe_path);
-  unlink(resp_pipe_path);
-  char buf[TAMMSG];
-  char sessionID[MAX_SESSION_COUNT];
-  strcpy(reqst_pipe_path,req_pipe_path);
-  strcpy(respn_pipe_path,resp_pipe_path);
+/// Sends a request and waits for its reply, sending it again while the server answers BUSY.
+/// @param shard Session to send the request on.
+/// @param request Request to send.
+/// @param payload Pointer to store the payload in, to be freed by the caller.
+/// @param payload_len Pointer to store the size of the payload in.
+/// @return The return value of the operation, 1 if the server could not be reached, REPLY_BUSY if it was still
+/// overloaded after CLIENT_BUSY_RETRIES retries.
+static int send_request_payload(struct Shard *shard, const char *request, char **payload, size_t *payload_len) {
+  *payload = NULL;
+  *payload_len = 0;
 
-  fillString(reqst_pipe_path,MAX_PATH_SIZE);
-  fillString(respn_pipe_path,MAX_PATH_SIZE);
+  int ret, streamed;
+  size_t size;
+  int failed = exchange(shard, request, &ret, &size, &streamed);
+  if (failed) {
+    return failed;
+  }
+
+  return receive_reply_payload(shard->resp_pipe, streamed, size, payload, payload_len) ? 1 : ret;
+}
+
+/// Sends a request and waits for its reply, writing the payload (if any) to out_fd.
+/// @note The payload is copied as it arrives, so a long LIST or SHOW is never held in memory.
+/// @param shard Session to send the request on.
+/// @param request Request to send.
+/// @param out_fd File descriptor to write the payload to, -1 to discard it.
+/// @return The return value of the operation, 1 if the server could not be reached.
+static int send_request(struct Shard *shard, const char *request, int out_fd) {
+  int ret, streamed;
+  size_t size;
+  int failed = exchange(shard, request, &ret, &size, &streamed);
+  if (failed) {
+    return failed;
+  }
+
+  return copy_reply_payload(shard->resp_pipe, streamed, size, ret == 0 ? out_fd : -1) ? 1 : ret;
+}
+
+/// Sets up a session with one server.
+/// @param shard Session to set up.
+/// @param server_pipe_path Path to the named pipe where the server is listening.
+/// @return 0 if the session was established successfully, REPLY_BUSY if the server had no room for it, 1 otherwise.
+static int connect_shard(struct Shard *shard, const char *server_pipe_path) {
+  unlink(shard->reqst_pipe_path);
+  unlink(shard->respn_pipe_path);
 
   // Criar os named pipes para comunicação entre cliente e servidor
-  if (mkfifo(req_pipe_path, 0666) == -1 || mkfifo(resp_pipe_path, 0666) == -1) {
+  if (mkfifo(shard->reqst_pipe_path, 0666) == -1 || mkfifo(shard->respn_pipe_path, 0666) == -1) {
     printf("Erro ao criar named pipes\n");
     return 1; // Retornar 1 em caso de erro
   }
-  
-  // Abrir os pipes para leitura e escrita
-  server_pipe = open(server_pipe_path, O_WRONLY);
-  
+
+  // The response pipe is opened before SETUP is sent, so that the server can open it without waiting for the client
+  if ((shard->resp_pipe = open(shard->respn_pipe_path, O_RDONLY | O_NONBLOCK)) < 0) {
+    perror("Read error");
+    return 1;
+  }
+
+  int server_pipe = open(server_pipe_path, O_WRONLY);
   if (server_pipe == -1) {
     printf("Erro ao abrir os pipes\n");
+    close(shard->resp_pipe);
     return 1; // Retornar 1 em caso de erro
   }
-  
-  sprintf(buf,"%s|%s|%s","OP_CODE=1",reqst_pipe_path,respn_pipe_path);
-  fillString(buf,TAMMSG);
-  write(server_pipe,buf, TAMMSG);
-  
-  if((resp_pipe = open(respn_pipe_path, O_RDONLY))<0)
-    perror("Read error");
-  read(resp_pipe,sessionID,sizeof(MAX_SESSION_COUNT));
-  
-  session_id= atoi(sessionID);
-  // Retornar 0 em caso de sucesso
+
+  char buf[TAMMSG];
+  // NORMAL is left implicit, so that servers that do not know about classes still accept the request
+  if (session_class == SESSION_CLASS_NORMAL) {
+    snprintf(buf, sizeof(buf), "OP_CODE=%d|%s|%s", OP_SETUP, shard->reqst_pipe_path, shard->respn_pipe_path);
+  } else {
+    snprintf(buf, sizeof(buf), "OP_CODE=%d|%s|%s|%d", OP_SETUP, shard->reqst_pipe_path, shard->respn_pipe_path,
+             session_class);
+  }
+  int failed = send_message(server_pipe, buf);
+  close(server_pipe);
+
+  // Until the server opens its side, a read would see the end of the pipe instead of waiting for the answer
+  struct pollfd answer = {.fd = shard->resp_pipe, .events = POLLIN};
+  while (!failed && poll(&answer, 1, -1) == -1) {
+    failed = errno != EINTR;
+  }
+  if (failed || fcntl(shard->resp_pipe, F_SETFL, 0) == -1) {
+    close(shard->resp_pipe);
+    return 1;
+  }
+
+  if (read_all(shard->resp_pipe, &shard->session_id, sizeof(shard->session_id))) {
+    shard->session_id = -1;
+  }
+
+  if (shard->session_id == SESSION_BUSY) {
+    busy_retry_after_ms = BUSY_RETRY_MIN_MS;
+    if (read_all(shard->resp_pipe, &busy_retry_after_ms, sizeof(busy_retry_after_ms))) {
+      busy_retry_after_ms = BUSY_RETRY_MIN_MS;
+    }
+    close(shard->resp_pipe);
+    return REPLY_BUSY;
+  }
+
+  if (shard->session_id < 0) {
+    fprintf(stderr, "The server refused the session\n");
+    close(shard->resp_pipe);
+    return 1;
+  }
+
+  if ((shard->req_pipe = open(shard->reqst_pipe_path, O_WRONLY)) < 0) {
+    perror("Write error");
+    close(shard->resp_pipe);
+    return 1;
+  }
+
   return 0;
 }
 
-int ems_quit(void) { 
-  //TODO: close pipes
-  char buf[TAMMSG];
-  strcpy(buf,"OP_CODE=2|" );
-  fillString(buf,TAMMSG);
-  write(req_pipe,buf, TAMMSG);
-  close(req_pipe);
-  close(resp_pipe);
-  unlink(reqst_pipe_path);
-  unlink(respn_pipe_path);
+void ems_set_session_class(enum SessionClass requested) { session_class = requested; }
+
+int ems_busy_retry_after(void) { return busy_retry_after_ms; }
+
+int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
+  char server_paths[PATH_MAX * 2];
+  if (strlen(server_pipe_path) >= sizeof(server_paths)) {
+    fprintf(stderr, "Server pipe path too long\n");
+    return 1;
+  }
+  strcpy(server_paths, server_pipe_path);
+
+  char *paths[MAX_SHARDS];
+  size_t count = 0;
+  char *saveptr = NULL;
+  for (char *path = strtok_r(server_paths, ",", &saveptr); path != NULL; path = strtok_r(NULL, ",", &saveptr)) {
+    if (count == MAX_SHARDS) {
+      fprintf(stderr, "Too many server pipes\n");
+      return 1;
+    }
+    paths[count++] = path;
+  }
+  if (count == 0) {
+    fprintf(stderr, "No server pipe\n");
+    return 1;
+  }
+
+  // With a single server the pipes keep their names; with several each gets a ".<shard>" suffix
+  for (num_shards = 0; num_shards < count; num_shards++) {
+    struct Shard *shard = &shards[num_shards];
+    int req_len = count == 1 ? snprintf(shard->reqst_pipe_path, MAX_PATH_SIZE, "%s", req_pipe_path)
+                             : snprintf(shard->reqst_pipe_path, MAX_PATH_SIZE, "%s.%zu", req_pipe_path, num_shards);
+    int resp_len = count == 1 ? snprintf(shard->respn_pipe_path, MAX_PATH_SIZE, "%s", resp_pipe_path)
+                              : snprintf(shard->respn_pipe_path, MAX_PATH_SIZE, "%s.%zu", resp_pipe_path, num_shards);
+    if (req_len < 0 || req_len >= MAX_PATH_SIZE || resp_len < 0 || resp_len >= MAX_PATH_SIZE) {
+      fprintf(stderr, "Pipe path too long\n");
+      ems_quit();
+      return 1;
+    }
+
+    int ret = connect_shard(shard, paths[num_shards]);
+    for (unsigned int attempt = 0; ret == REPLY_BUSY && attempt < CLIENT_BUSY_RETRIES; attempt++) {
+      backoff(attempt, busy_retry_after_ms);
+      ret = connect_shard(shard, paths[num_shards]);
+    }
+
+    if (ret != 0) {
+      if (ret == REPLY_BUSY) fprintf(stderr, "The server is busy, try again in %d ms\n", busy_retry_after_ms);
+      unlink(shard->reqst_pipe_path);
+      unlink(shard->respn_pipe_path);
+      ems_quit();
+      return 1;
+    }
+  }
+
   return 0;
 }
 
+int ems_quit(void) {
+  char buf[TAMMSG];
+  snprintf(buf, sizeof(buf), "OP_CODE=%d", OP_QUIT);
+
+  int ret = 0;
+  for (size_t i = 0; i < num_shards; i++) {
+    struct Shard *shard = &shards[i];
+    if (send_message(shard->req_pipe, buf)) ret = 1;
+
+    close(shard->req_pipe);
+    close(shard->resp_pipe);
+    unlink(shard->reqst_pipe_path);
+    unlink(shard->respn_pipe_path);
+  }
+
+  num_shards = 0;
+  return ret;
+}
+
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-  //TODO: send create request to the server (through the request pipe) and wait for the response (through the response pipe)
   char buf[TAMMSG];
-  sprintf(buf,"%s|%d|%ld|%ld","OP_CODE=3",event_id,num_rows,num_cols);
-  fillString(buf,TAMMSG);
-  write(req_pipe,buf, TAMMSG);
-  
-  return 0;
+  snprintf(buf, sizeof(buf), "OP_CODE=%d|%u|%zu|%zu", OP_CREATE, event_id, num_rows, num_cols);
+  return send_request(shard_of(event_id), buf, -1);
 }
 
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  //TODO: send reserve request to the server (through the request pipe) and wait for the response (through the response pipe)
+  char list_xs[TAMMSG / 2], list_ys[TAMMSG / 2];
+  if (format_coords(list_xs, sizeof(list_xs), xs, num_seats) || format_coords(list_ys, sizeof(list_ys), ys, num_seats)) {
+    fprintf(stderr, "Reservation too large\n");
+    return 1;
+  }
+
   char buf[TAMMSG];
-  sprintf(buf,"%s|%d|%ld|%s|%s","OP_CODE=4",event_id,num_seats,arrayXY(xs,num_seats),arrayXY(ys,num_seats));
-  fillString(buf,TAMMSG);
-  write(req_pipe,buf, TAMMSG);
+  int len = snprintf(buf, sizeof(buf), "OP_CODE=%d|%u|%zu|%s|%s", OP_RESERVE, event_id, num_seats, list_xs, list_ys);
+  if (len < 0 || (size_t)len >= sizeof(buf)) {
+    fprintf(stderr, "Reservation too large\n");
+    return 1;
+  }
 
-  return 0;
+  return send_request(shard_of(event_id), buf, -1);
+}
+
+int ems_reserve_ranges(unsigned int event_id, size_t num_ranges, const struct SeatRange *ranges) {
+  char list_rows[TAMMSG / 2], list_cols[TAMMSG / 2];
+  if (format_spans(list_rows, sizeof(list_rows), ranges, num_ranges, 1) ||
+      format_spans(list_cols, sizeof(list_cols), ranges, num_ranges, 0)) {
+    fprintf(stderr, "Reservation too large\n");
+    return 1;
+  }
+
+  char buf[TAMMSG];
+  int len = snprintf(buf, sizeof(buf), "OP_CODE=%d|%u|%zu|%s|%s", OP_RESERVE_RANGES, event_id, num_ranges, list_rows,
+                     list_cols);
+  if (len < 0 || (size_t)len >= sizeof(buf)) {
+    fprintf(stderr, "Reservation too large\n");
+    return 1;
+  }
+
+  return send_request(shard_of(event_id), buf, -1);
+}
+
+int ems_reserve_multi(unsigned int event_id, size_t num_groups, size_t *sizes, size_t *xs, size_t *ys, int *results) {
+  size_t num_seats = 0;
+  for (size_t g = 0; g < num_groups; g++) num_seats += sizes[g];
+
+  char list_sizes[TAMMSG / 4], list_xs[TAMMSG / 4], list_ys[TAMMSG / 4];
+  char buf[TAMMSG];
+  int len = -1;
+  if (num_groups > 0 && num_groups <= MAX_RESERVATION_GROUPS &&
+      !format_coords(list_sizes, sizeof(list_sizes), sizes, num_groups) &&
+      !format_coords(list_xs, sizeof(list_xs), xs, num_seats) && !format_coords(list_ys, sizeof(list_ys), ys, num_seats)) {
+    len = snprintf(buf, sizeof(buf), "OP_CODE=%d|%u|%zu|%s|%s|%s", OP_RESERVE_MULTI, event_id, num_groups, list_sizes,
+                   list_xs, list_ys);
+  }
+  if (len < 0 || (size_t)len >= sizeof(buf)) {
+    fprintf(stderr, "Reservation too large\n");
+    return 1;
+  }
+
+  char *payload;
+  size_t payload_len;
+  int ret = send_request_payload(shard_of(event_id), buf, &payload, &payload_len);
+  if (ret == 0 && payload_len != num_groups * sizeof(int)) {
+    ret = 1;
+  }
+  if (ret == 0) {
+    memcpy(results, payload, payload_len);
+  }
+
+  free(payload);
+  return ret;
 }
 
 int ems_show(int out_fd, unsigned int event_id) {
-  //TODO: send show request to the server (through the request pipe) and wait for the response (through the response pipe)
-  
   char buf[TAMMSG];
-  char atribts[5][MAX_RESERVATION_SIZE];
-  sprintf(buf,"%s|%d|%d","OP_CODE=5",out_fd,event_id);
-
-  char buffer[TAMMSG*2];
-  resp_pipe=open(respn_pipe_path,O_WRONLY);
-  read(resp_pipe,buffer,TAMMSG*2);
-  fillString(buffer,TAMMSG);
-  parseMsg(buffer,atribts);
-  
-  write(out_fd,atribts[3],MAX_RESERVATION_SIZE);
-  return 0;
+  snprintf(buf, sizeof(buf), "OP_CODE=%d|%u", OP_SHOW, event_id);
+  return send_request(shard_of(event_id), buf, out_fd);
 }
 
-int ems_list_events(int out_fd) {
-  //TODO: send list request to the server (through the request pipe) and wait for the response (through the response pipe)
+int ems_stats(int out_fd, unsigned int event_id) {
   char buf[TAMMSG];
-  char atribts[5][MAX_RESERVATION_SIZE];
-  sprintf(buf,"%s|%d","OP_CODE=5",out_fd);
-  fillString(buf,TAMMSG);
-  parseMsg(buf,atribts);
-  
-  //write(out_fd,atribts[3],MAX_RESERVATION_SIZE);
-  return 0;
+  snprintf(buf, sizeof(buf), "OP_CODE=%d|%u", OP_STATS, event_id);
+  return send_request(shard_of(event_id), buf, out_fd);
+}
+
+int ems_delete(unsigned int event_id, int archive) {
+  char buf[TAMMSG];
+  snprintf(buf, sizeof(buf), "OP_CODE=%d|%u|%d", OP_DELETE, event_id, archive);
+  return send_request(shard_of(event_id), buf, -1);
+}
+
+/// Formats a LIST query.
+/// @param buf Buffer to store the request in.
+/// @param query Page and filters of the query.
+/// @param after_id Only events with greater ids, in place of the after_id of the query.
+static void format_list_query(char buf[TAMMSG], const struct ListQuery *query, unsigned int after_id) {
+  snprintf(buf, TAMMSG, "OP_CODE=%d|%u|%zu|%u|%u|%zu|%zu", OP_LIST, after_id, query->limit, query->filters,
+           query->occupancy, query->min_seats, query->max_seats);
+}
+
+/// Closes a session whose replies can no longer be told apart, so that its later requests fail instead of reading
+/// the rest of this one.
+static void drop_shard(struct Shard *shard) {
+  fprintf(stderr, "Lost the session with server %zu\n", (size_t)(shard - shards));
+  close(shard->req_pipe);
+  close(shard->resp_pipe);
+  shard->req_pipe = -1;
+  shard->resp_pipe = -1;
+}
+
+/// Page of the events of a shard, merged with the pages of the others.
+struct ShardPage {
+  char *payload;    /// Reply of the shard, to be released with free.
+  size_t len;       /// Size of the payload.
+  size_t pos;       /// Offset of the line after the current one.
+  size_t lines;     /// Events of the page up to the current one.
+  int has_event;    /// Whether there is a current event: the next one the shard lists.
+  unsigned int id;  /// Id of the current event, or of the last one of the page once it is over.
+  char *line;       /// Line of the current event, without its newline.
+};
+
+/// Moves a page on to its next event.
+/// @param page Page of a shard.
+static void next_listed(struct ShardPage *page) {
+  page->has_event = 0;
+  while (page->pos < page->len) {
+    char *line = page->payload + page->pos;
+    char *end = memchr(line, '\n', page->len - page->pos);
+    if (end == NULL) {
+      page->pos = page->len;
+      return;
+    }
+    *end = '\0';
+    page->pos = (size_t)(end - page->payload) + 1;
+
+    // Each event is a line starting with "Event: <id>"; an empty page is "No events\n"
+    if (sscanf(line, "Event: %u", &page->id) == 1) {
+      page->line = line;
+      page->lines++;
+      page->has_event = 1;
+      return;
+    }
+  }
+}
+
+/// Receives a page of the events of a shard.
+/// @note The reply is always read in full, or the session is dropped, so that it stays in step with the shard.
+/// @param shard Session with the shard.
+/// @param request LIST query of the page.
+/// @param sent Whether the request was already sent, otherwise it is sent here.
+/// @param page Page to store the events in, moved to its first event.
+/// @return 0 if the page was received successfully, 1 otherwise.
+static int receive_page(struct Shard *shard, const char *request, int sent, struct ShardPage *page) {
+  free(page->payload);
+  memset(page, 0, sizeof(*page));
+
+  int ret, streamed;
+  size_t size;
+  int failed = 0;
+  if (sent) {
+    failed = receive_reply_header(shard->resp_pipe, &ret, &size, &streamed);
+    if (!failed && ret == REPLY_BUSY) {
+      // Only this shard is asked again, with the usual backoff
+      char *payload;
+      size_t payload_len;
+      failed = receive_reply_payload(shard->resp_pipe, streamed, size, &payload, &payload_len);
+      if (!failed && payload_len == sizeof(int)) memcpy(&busy_retry_after_ms, payload, sizeof(int));
+      free(payload);
+      if (!failed) backoff(0, busy_retry_after_ms);
+      sent = 0;
+    }
+  }
+  if (!failed && !sent) {
+    failed = exchange(shard, request, &ret, &size, &streamed);
+    if (failed == REPLY_BUSY) return 1;  // Every BUSY answer was read
+  }
+
+  if (failed || receive_reply_payload(shard->resp_pipe, streamed, size, &page->payload, &page->len)) {
+    drop_shard(shard);
+    return 1;
+  }
+
+  next_listed(page);
+  return ret != 0;
+}
+
+/// Lists the events of every shard, merged in id order.
+/// @note The shards are asked for pages of LIST queries, which come in id order, and each shard is asked for its
+/// next page only when the merge gets to its end, so no more than a page per shard is held in memory.
+/// @param query Page and filters of the query.
+/// @param limit Most events to print, SIZE_MAX for all of them.
+/// @param plain Whether to print the events as a plain LIST does, with their ids only.
+/// @param out_fd File descriptor to print the events to, -1 to discard them.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+static int list_shards(const struct ListQuery *query, size_t limit, int plain, int out_fd) {
+  size_t page_size = query->limit == 0 || query->limit > LIST_PAGE_MAX ? LIST_PAGE_MAX : query->limit;
+  char request[TAMMSG];
+  format_list_query(request, query, query->after_id);
+
+  // Every shard gets the first request before any reply is read, so that they list their events in parallel
+  int ret = 0;
+  int sent[MAX_SHARDS];
+  for (size_t i = 0; i < num_shards; i++) {
+    sent[i] = send_message(shards[i].req_pipe, request) == 0;
+    if (!sent[i]) ret = 1;
+  }
+
+  // Every reply is read even after an error, so that no session is left with an unread one
+  struct ShardPage pages[MAX_SHARDS];
+  memset(pages, 0, sizeof(pages));
+  for (size_t i = 0; i < num_shards; i++) {
+    if (sent[i] && receive_page(&shards[i], request, 1, &pages[i])) ret = 1;
+  }
+
+  size_t printed = 0;
+  while (ret == 0 && printed < limit) {
+    size_t next = num_shards;
+    for (size_t i = 0; i < num_shards; i++) {
+      if (pages[i].has_event && (next == num_shards || pages[i].id < pages[next].id)) next = i;
+    }
+    if (next == num_shards) break;
+
+    struct ShardPage *page = &pages[next];
+    char line[32];
+    if (plain) snprintf(line, sizeof(line), "Event: %u", page->id);
+    if (out_fd >= 0 && (print_str(out_fd, plain ? line : page->line) || print_str(out_fd, "\n"))) ret = 1;
+    printed++;
+
+    // A full page may not be the last one of the shard
+    next_listed(page);
+    if (!page->has_event && page->lines == page_size && printed < limit) {
+      format_list_query(request, query, page->id);
+      if (receive_page(&shards[next], request, 0, page)) ret = 1;
+    }
+  }
+
+  if (ret == 0 && printed == 0 && out_fd >= 0 && print_str(out_fd, "No events\n")) ret = 1;
+
+  for (size_t i = 0; i < num_shards; i++) free(pages[i].payload);
+  return ret;
+}
+
+int ems_list_events(int out_fd) {
+  if (num_shards == 1) {
+    char buf[TAMMSG];
+    snprintf(buf, sizeof(buf), "OP_CODE=%d", OP_LIST);
+    return send_request(&shards[0], buf, out_fd);
+  }
+
+  // Each server streams its events in the order of its slots, so they are merged from pages in id order instead
+  struct ListQuery query = {.limit = LIST_PAGE_MAX};
+  return list_shards(&query, SIZE_MAX, 1, out_fd);
+}
+
+int ems_list_query(int out_fd, const struct ListQuery *query) {
+  if (num_shards == 1) {
+    char buf[TAMMSG];
+    format_list_query(buf, query, query->after_id);
+    return send_request(&shards[0], buf, out_fd);
+  }
+
+  // Each shard answers its own first page, and the page is the first of their events merged
+  size_t limit = query->limit == 0 || query->limit > LIST_PAGE_MAX ? LIST_PAGE_MAX : query->limit;
+  return list_shards(query, limit, 0, out_fd);
 }
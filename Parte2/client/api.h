@@ -3,13 +3,30 @@
 
 #include <stddef.h>
 
-/// Connects to an EMS server.
+#include "common/protocol.h"
+
+/// Connects to an EMS server, or to several servers sharing the events.
+/// @note With a comma-separated list of N server pipes, the server at index i owns the events with event_id % N == i:
+/// each operation goes to the owner of its event and LIST is sent to every server. Each session gets its own pair of
+/// pipes, named after the given paths with a ".<i>" suffix.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
 /// @param resp_pipe_path Path to the name pipe to be created for responses.
-/// @param server_pipe_path Path to the name pipe where the server is listening.
+/// @param server_pipe_path Path to the name pipe where the server is listening, or a comma-separated list of them.
 /// @return 0 if the connection was established successfully, 1 otherwise.
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path);
 
+/// Sets the scheduling class requested by the following calls to ems_setup.
+/// @note PRIORITY is meant for admin and box-office clients, whose requests are served ahead of the others.
+/// @param requested Class of the sessions, SESSION_CLASS_NORMAL by default.
+void ems_set_session_class(enum SessionClass requested);
+
+/// Gets the retry-after hint of the last time a server answered BUSY.
+/// @note While a server is overloaded it refuses requests and sessions as BUSY, without executing them. The API sends
+/// them again with exponential backoff, waiting at least the server's hint, up to CLIENT_BUSY_RETRIES times; after
+/// that ems_setup fails and the other calls return REPLY_BUSY.
+/// @return Suggested wait before trying again, in milliseconds, 0 if no server has answered BUSY.
+int ems_busy_retry_after(void);
+
 /// Disconnects from an EMS server.
 /// @return 0 in case of success, 1 otherwise.
 int ems_quit(void);
@@ -29,15 +46,53 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
 
+/// Creates a reservation for every seat in the given ranges, sending the ranges instead of each seat.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_ranges Number of ranges.
+/// @param ranges Array of blocks of seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_ranges(unsigned int event_id, size_t num_ranges, const struct SeatRange* ranges);
+
+/// Creates several independent reservations for the given event in a single request.
+/// @param event_id Id of the event to create the reservations for.
+/// @param num_groups Number of reservations, at most MAX_RESERVATION_GROUPS.
+/// @param sizes Array with the number of seats of each reservation.
+/// @param xs Array of rows of the seats, the seats of each reservation after those of the previous one.
+/// @param ys Array of columns of the seats, in the same order as xs.
+/// @param results Array to store, for each reservation, 0 if it was created and 1 otherwise.
+/// @return 0 if the reservations were attempted, 1 if the event does not exist or the request failed.
+int ems_reserve_multi(unsigned int event_id, size_t num_groups, size_t* sizes, size_t* xs, size_t* ys, int* results);
+
 /// Prints the given event to the given file.
 /// @param out_fd File descriptor to print the event to.
 /// @param event_id Id of the event to print.
 /// @return 0 if the event was printed successfully, 1 otherwise.
 int ems_show(int out_fd, unsigned int event_id);
 
+/// Prints how full the given event and each of its rows are to the given file, without fetching its seats.
+/// @param out_fd File descriptor to print the statistics to.
+/// @param event_id Id of the event.
+/// @return 0 if the statistics were printed successfully, 1 otherwise.
+int ems_stats(int out_fd, unsigned int event_id);
+
+/// Deletes the given event, releasing its seats on the server.
+/// @param event_id Id of the event to delete.
+/// @param archive Whether the server writes the final state of the event to its archive directory first.
+/// @return 0 if the event was deleted successfully, 1 otherwise.
+int ems_delete(unsigned int event_id, int archive);
+
 /// Prints all the events to the given file.
+/// @note With several servers, their events are merged in id order.
 /// @param out_fd File descriptor to print the events to.
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd);
 
+/// Prints a page of the events that pass the filters of a query to the given file.
+/// @note With several servers, each returns its own page and the first events of their pages merged in id order
+/// make the page printed.
+/// @param out_fd File descriptor to print the events to.
+/// @param query Page and filters of the query.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+int ems_list_query(int out_fd, const struct ListQuery* query);
+
 #endif  // CLIENT_API_H
@@ -8,8 +8,18 @@
 #include "parser.h"
 
 int main(int argc, char* argv[]) {
+  // -p: sessão prioritária (clientes de administração e bilheteiras)
+  if (argc > 1 && strcmp(argv[1], "-p") == 0) {
+    ems_set_session_class(SESSION_CLASS_PRIORITY);
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+  }
+
   if (argc < 5) {
-    fprintf(stderr, "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path>\n",
+    fprintf(stderr,
+            "Usage: %s [-p] <request pipe path> <response pipe path> <server pipe path>[,<server pipe path>...]"
+            " <.jobs file path>\n",
             argv[0]);
     return 1;
   }
@@ -48,6 +58,9 @@ int main(int argc, char* argv[]) {
     size_t num_rows, num_columns, num_coords;
     unsigned int delay = 0;
     size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    struct SeatRange ranges[MAX_RESERVATION_SIZE];
+    struct ListQuery query;
+    int archive;
 
     switch (get_next(in_fd)) {
       case CMD_CREATE:
@@ -60,14 +73,26 @@ int main(int argc, char* argv[]) {
         break;
 
       case CMD_RESERVE:
-        num_coords = parse_reserve(in_fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+        num_coords = parse_reserve(in_fd, MAX_RESERVATION_SIZE, &event_id, ranges);
 
         if (num_coords == 0) {
           fprintf(stderr, "Invalid command reserve. See HELP for usage\n");
           continue;
         }
 
-        if (ems_reserve(event_id, num_coords, xs, ys)) fprintf(stderr, "Failed to reserve seats\n");
+        // Lists of single seats keep using the coordinates, any segment or block is sent as ranges
+        size_t num_seats = 0;
+        while (num_seats < num_coords && ranges[num_seats].first_row == ranges[num_seats].last_row &&
+               ranges[num_seats].first_col == ranges[num_seats].last_col) {
+          xs[num_seats] = ranges[num_seats].first_row;
+          ys[num_seats] = ranges[num_seats].first_col;
+          num_seats++;
+        }
+
+        if (num_seats == num_coords ? ems_reserve(event_id, num_coords, xs, ys)
+                                    : ems_reserve_ranges(event_id, num_coords, ranges)) {
+          fprintf(stderr, "Failed to reserve seats\n");
+        }
         break;
 
       case CMD_SHOW:
@@ -79,10 +104,37 @@ int main(int argc, char* argv[]) {
         if (ems_show(out_fd, event_id)) fprintf(stderr, "Failed to show event\n");
         break;
 
+      case CMD_STATS:
+        if (parse_show(in_fd, &event_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_stats(out_fd, event_id)) fprintf(stderr, "Failed to get event statistics\n");
+        break;
+
+      case CMD_DELETE:
+        if (parse_delete(in_fd, &event_id, &archive) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_delete(event_id, archive)) fprintf(stderr, "Failed to delete event\n");
+        break;
+
       case CMD_LIST_EVENTS:
         if (ems_list_events(out_fd)) fprintf(stderr, "Failed to list events\n");
         break;
 
+      case CMD_LIST_QUERY:
+        if (parse_list(in_fd, &query) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_list_query(out_fd, &query)) fprintf(stderr, "Failed to list events\n");
+        break;
+
       case CMD_WAIT:
         if (parse_wait(in_fd, &delay, NULL) == -1) {
             fprintf(stderr, "Invalid command. See HELP for usage\n");
@@ -103,14 +155,19 @@ int main(int argc, char* argv[]) {
         printf(
             "Available commands:\n"
             "  CREATE <event_id> <num_rows> <num_columns>\n"
-            "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+            "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2a>-<y2b>) [<x3a>-<x3b>]x[<y3a>-<y3b>] ...]\n"
+            "      (the enclosing brackets are optional: RESERVE 1 (2,1-3) [3-4]x[2-3])\n"
             "  SHOW <event_id>\n"
-            "  LIST\n"
+            "  STATS <event_id>\n"
+            "  DELETE <event_id> [ARCHIVE]\n"
+            "  LIST [<after_id> [<limit>]] [FREE] [ABOVE <percent>] [SIZE <min_seats>-<max_seats>]\n"
             "  WAIT <delay_ms>\n"
+            "  BARRIER\n"
             "  HELP\n");
 
         break;
 
+      case CMD_BARRIER:  // The client sends one request at a time, so every previous command has already been issued
       case CMD_EMPTY:
         break;
 
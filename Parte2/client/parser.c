@@ -14,6 +14,11 @@ static void cleanup(int fd) {
     ;
 }
 
+/// Skips the rest of a line, unless the character last read already ended it.
+static void skip_line(int fd, char last) {
+  if (last != '\n' && last != '\0') cleanup(fd);
+}
+
 enum Command get_next(int fd) {
   char buf[16];
   if (read(fd, buf, 1) != 1) {
@@ -38,13 +43,35 @@ enum Command get_next(int fd) {
       return CMD_RESERVE;
 
     case 'S':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
+      if (read(fd, buf + 1, 1) != 1) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      if (buf[1] == 'T') {
+        if (read(fd, buf + 2, 4) != 4 || strncmp(buf, "STATS ", 6) != 0) {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        return CMD_STATS;
+      }
+
+      if (read(fd, buf + 2, 3) != 3 || strncmp(buf, "SHOW ", 5) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
       return CMD_SHOW;
 
+    case 'D':
+      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "DELETE ", 7) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_DELETE;
+
     case 'L':
       if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
         cleanup(fd);
@@ -52,12 +79,29 @@ enum Command get_next(int fd) {
       }
 
       if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+        if (buf[4] == ' ') {
+          return CMD_LIST_QUERY;
+        }
+
         cleanup(fd);
         return CMD_INVALID;
       }
 
       return CMD_LIST_EVENTS;
 
+    case 'B':
+      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      if (read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_BARRIER;
+
     case 'W':
       if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
         cleanup(fd);
@@ -117,59 +161,128 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_c
   return 0;
 }
 
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
-  char ch;
+/// Parses an unsigned integer whose first digit was already read.
+/// @param fd File descriptor to read from.
+/// @param first First character of the integer.
+/// @param value Pointer to store the value in.
+/// @param next Pointer to store the character after the integer in, '\0' at the end of the file.
+/// @return 0 if the integer was parsed successfully, 1 otherwise.
+static int parse_uint_from(int fd, char first, unsigned int *value, char *next) {
+  *next = first;
+  if (first < '0' || first > '9') {
+    return 1;
+  }
 
-  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
-    return 0;
+  unsigned long parsed = 0;
+  while (*next >= '0' && *next <= '9') {
+    parsed = parsed * 10 + (unsigned long)(*next - '0');
+    if (parsed > UINT_MAX) {
+      return 1;
+    }
+    if (read(fd, next, 1) != 1) *next = '\0';
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
-    return 0;
+  *value = (unsigned int)parsed;
+  return 0;
+}
+
+/// Reads the next character, '\0' at the end of the file.
+static char next_char(int fd) {
+  char ch;
+  return read(fd, &ch, 1) == 1 ? ch : '\0';
+}
+
+/// Parses a span "<a>" or "<a>-<b>" followed by a given character.
+/// @param fd File descriptor to read from.
+/// @param end Character expected after the span.
+/// @param start Pointer to store the start of the span in.
+/// @param stop Pointer to store the end of the span in, the same as the start for "<a>".
+/// @param ch Pointer to the last character read, the first one of the span when called.
+/// @return 0 if the span was parsed successfully, 1 otherwise.
+static int parse_span(int fd, char end, size_t *start, size_t *stop, char *ch) {
+  unsigned int value;
+  if (parse_uint_from(fd, *ch, &value, ch) != 0) {
+    return 1;
   }
+  *start = *stop = (size_t)value;
 
-  size_t num_coords = 0;
-  while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
-      cleanup(fd);
-      return 0;
+  if (*ch == '-') {
+    if (parse_uint_from(fd, next_char(fd), &value, ch) != 0) {
+      return 1;
     }
+    *stop = (size_t)value;
+  }
+
+  return *ch != end;
+}
 
+/// Parses a seat selector: a seat "(<x>,<y>)", a row segment "(<x>,<y1>-<y2>)" or a block "[<x1>-<x2>]x[<y1>-<y2>]".
+/// @param fd File descriptor to read from.
+/// @param open Opening character of the selector, already read.
+/// @param range Pointer to store the selected block of seats in.
+/// @param ch Pointer to the last character read, the one after the opening character when called.
+/// @return 0 if the selector was parsed successfully, 1 otherwise.
+static int parse_selector(int fd, char open, struct SeatRange *range, char *ch) {
+  if (open == '(') {
     unsigned int x;
-    if (parse_uint(fd, &x, &ch) != 0 || ch != ',') {
-      cleanup(fd);
-      return 0;
+    if (parse_uint_from(fd, *ch, &x, ch) != 0 || *ch != ',' || (*ch = next_char(fd)) == '\0' ||
+        parse_span(fd, ')', &range->first_col, &range->last_col, ch)) {
+      return 1;
     }
-    xs[num_coords] = (size_t)x;
+    range->first_row = range->last_row = (size_t)x;
+    return 0;
+  }
 
-    unsigned int y;
-    if (parse_uint(fd, &y, &ch) != 0 || ch != ')') {
-      cleanup(fd);
-      return 0;
-    }
-    ys[num_coords] = (size_t)y;
+  return open != '[' || parse_span(fd, ']', &range->first_row, &range->last_row, ch) || (*ch = next_char(fd)) != 'x' ||
+         (*ch = next_char(fd)) != '[' || (*ch = next_char(fd)) == '\0' ||
+         parse_span(fd, ']', &range->first_col, &range->last_col, ch);
+}
 
-    num_coords++;
+size_t parse_reserve(int fd, size_t max, unsigned int *event_id, struct SeatRange *ranges) {
+  char ch;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
-      cleanup(fd);
+  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
+    skip_line(fd, ch);
+    return 0;
+  }
+
+  // The selectors may be enclosed in brackets, "[(1,1) (2,3)]", or not, "(1,1) (2,3)". A '[' starts a block instead
+  // when a digit follows it
+  char open = next_char(fd);
+  ch = open == '\n' ? '\n' : next_char(fd);
+  int enclosed = open == '[' && (ch == '(' || ch == '[');
+  if (enclosed) {
+    open = ch;
+    ch = next_char(fd);
+  }
+
+  size_t num_coords = 0;
+  while (1) {
+    if (num_coords == max || parse_selector(fd, open, &ranges[num_coords], &ch)) {
+      skip_line(fd, ch);
       return 0;
     }
+    num_coords++;
 
-    if (ch == ']') {
+    ch = next_char(fd);
+    if (ch != ' ') {
       break;
     }
+
+    open = next_char(fd);
+    ch = open == '\n' ? '\n' : next_char(fd);
   }
 
-  if (num_coords == max) {
-    cleanup(fd);
+  // A closing bracket ends the selectors that were enclosed, then the line does
+  if (enclosed && ch == ']') {
+    ch = next_char(fd);
+  } else if (enclosed) {
+    skip_line(fd, ch);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (ch != '\n' && ch != '\0') {
+    skip_line(fd, ch);
     return 0;
   }
 
@@ -187,6 +300,114 @@ int parse_show(int fd, unsigned int *event_id) {
   return 0;
 }
 
+/// Reads a word, up to a space, a newline or the end of the file.
+/// @param fd File descriptor to read from.
+/// @param word Buffer to store the word in.
+/// @param size Size of the buffer.
+/// @param next Pointer to store the character after the word in, '\0' at the end of the file.
+/// @return 0 if a word that fits in the buffer was read, 1 otherwise.
+static int read_word(int fd, char *word, size_t size, char *next) {
+  size_t len = 0;
+  while (1) {
+    if (read(fd, next, 1) != 1) {
+      *next = '\0';
+    }
+    if (*next == ' ' || *next == '\n' || *next == '\0') {
+      break;
+    }
+
+    if (len + 1 == size) {
+      return 1;
+    }
+    word[len++] = *next;
+  }
+
+  word[len] = '\0';
+  return len == 0;
+}
+
+/// Parses a whole word as an unsigned integer.
+/// @return 0 if the word is an unsigned integer, 1 otherwise.
+static int word_uint(const char *word, unsigned int *value) {
+  char *endptr;
+  unsigned long parsed = strtoul(word, &endptr, 10);
+  if (endptr == word || *endptr != '\0' || parsed > UINT_MAX) {
+    return 1;
+  }
+
+  *value = (unsigned int)parsed;
+  return 0;
+}
+
+int parse_delete(int fd, unsigned int *event_id, int *archive) {
+  char ch;
+  if (parse_uint(fd, event_id, &ch) != 0) {
+    cleanup(fd);
+    return 1;
+  }
+
+  *archive = 0;
+  if (ch == ' ') {
+    char word[16];
+    if (read_word(fd, word, sizeof(word), &ch) || strcmp(word, "ARCHIVE") != 0) {
+      skip_line(fd, ch);
+      return 1;
+    }
+    *archive = 1;
+  }
+
+  if (ch != '\n' && ch != '\0') {
+    cleanup(fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+int parse_list(int fd, struct ListQuery *query) {
+  memset(query, 0, sizeof(*query));
+
+  // The numbers come first: after_id, then limit
+  unsigned int numbers = 0;
+  char word[32], ch = ' ';
+  while (ch == ' ') {
+    unsigned int value;
+    if (read_word(fd, word, sizeof(word), &ch)) {
+      skip_line(fd, ch);
+      return 1;
+    }
+
+    if (word_uint(word, &value) == 0 && numbers < 2 && query->filters == 0) {
+      if (numbers++ == 0) {
+        query->after_id = value;
+      } else {
+        query->limit = value;
+      }
+    } else if (strcmp(word, "FREE") == 0) {
+      query->filters |= LIST_FILTER_FREE;
+    } else if (strcmp(word, "ABOVE") == 0 && ch == ' ' && read_word(fd, word, sizeof(word), &ch) == 0 &&
+               word_uint(word, &query->occupancy) == 0 && query->occupancy <= 100) {
+      query->filters |= LIST_FILTER_OCCUPANCY;
+    } else if (strcmp(word, "SIZE") == 0 && ch == ' ' && read_word(fd, word, sizeof(word), &ch) == 0) {
+      unsigned int min_seats, max_seats;
+      char *dash = strchr(word, '-');
+      if (dash != NULL) *dash = '\0';
+      if (dash == NULL || word_uint(word, &min_seats) || word_uint(dash + 1, &max_seats) || min_seats > max_seats) {
+        skip_line(fd, ch);
+        return 1;
+      }
+      query->filters |= LIST_FILTER_SIZE;
+      query->min_seats = min_seats;
+      query->max_seats = max_seats;
+    } else {
+      skip_line(fd, ch);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   char ch;
 
@@ -3,11 +3,17 @@
 
 #include <stddef.h>
 
+#include "common/protocol.h"
+
 enum Command {
   CMD_CREATE,
   CMD_RESERVE,
   CMD_SHOW,
+  CMD_STATS,
+  CMD_DELETE,
   CMD_LIST_EVENTS,
+  CMD_LIST_QUERY,
+  CMD_BARRIER,
   CMD_WAIT,
   CMD_HELP,
   CMD_EMPTY,
@@ -29,20 +35,34 @@ enum Command get_next(int fd);
 int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_cols);
 
 /// Parses a RESERVE command.
+/// @note Each selector is a seat "(<x>,<y>)", a row segment "(<x>,<y1>-<y2>)" or a block "[<x1>-<x2>]x[<y1>-<y2>]",
+/// separated by spaces. The selectors may be enclosed in brackets, "[(1,1) (1,2)]", or not, "(1,1) (1,2)".
 /// @param fd File descriptor to read from.
-/// @param max Maximum number of coordinates to read.
+/// @param max Maximum number of selectors to read.
 /// @param event_id Pointer to the variable to store the event ID in.
-/// @param xs Pointer to the array to store the X coordinates in.
-/// @param ys Pointer to the array to store the Y coordinates in.
-/// @return Number of coordinates read. 0 on failure.
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys);
+/// @param ranges Pointer to the array to store the selected blocks of seats in.
+/// @return Number of selectors read. 0 on failure.
+size_t parse_reserve(int fd, size_t max, unsigned int *event_id, struct SeatRange *ranges);
 
-/// Parses a SHOW command.
+/// Parses a SHOW or STATS command.
 /// @param fd File descriptor to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
 int parse_show(int fd, unsigned int *event_id);
 
+/// Parses a DELETE command: "<event_id> [ARCHIVE]".
+/// @param fd File descriptor to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @param archive Pointer to store whether the event is to be archived in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_delete(int fd, unsigned int *event_id, int *archive);
+
+/// Parses the arguments of a LIST command: "[<after_id> [<limit>]] [FREE] [ABOVE <percent>] [SIZE <min>-<max>]".
+/// @param fd File descriptor to read from.
+/// @param query Pointer to the query to store the page and filters in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_list(int fd, struct ListQuery *query);
+
 /// Parses a WAIT command.
 /// @param fd File descriptor to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
@@ -1,6 +1,25 @@
 #define MAX_RESERVATION_SIZE 256
+#define MAX_RESERVATION_GROUPS 64  // Reservations of a RESERVE_MULTI, which share its MAX_RESERVATION_SIZE seats
 #define STATE_ACCESS_DELAY_US 500000  // 500ms
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define MAX_SESSION_COUNT 8
-#define TAMMSG 2000
-#define MAX_PATH_SIZE 40
\ No newline at end of file
+#define MAX_SHARDS 16  // Servers a client can spread the events over
+#define TAMMSG 4096  // Fixed message size; must not exceed PIPE_BUF (checked in protocol.h), which is 512 on macOS
+#define MAX_PATH_SIZE 40
+#define DIAGNOSTICS_FILE "ems.diag"
+#define EVENT_CACHE_SIZE 64
+#define EVENT_CACHE_WAYS 4  // Entries of each set of the event cache, a power of two; each set has its own lock
+#define STREAM_CHUNK_SIZE 16384  // Bytes of each chunk of a LIST or SHOW reply
+#define LIST_PAGE_MAX 1024       // Events of a page of a LIST query
+#define CACHE_LINE_SIZE 64  // Alignment of the fields of an event written by reservations
+#define EVENT_SLAB_CHUNK 64  // Events per chunk of the event list
+#define MAX_ASYNC_THREADS 64  // Executor threads of the async server
+#define MAX_PLACEMENT_NODES 8  // CPU sets the async server places events and executors on
+#define ASYNC_MAX_SESSIONS 256  // Sessions multiplexed by the async server
+#define ASYNC_DRR_QUANTUM 16  // Cost a session of the async server may spend each time its turn comes
+#define ASYNC_PRIORITY_BURST 8  // PRIORITY requests served in a row while NORMAL sessions are waiting
+#define ASYNC_QUEUE_LIMIT 128  // NORMAL requests waiting for the executors of a node before new ones are refused as BUSY
+#define BUSY_RETRY_MIN_MS 1  // Smallest retry-after hint sent with BUSY
+#define CLIENT_BUSY_RETRIES 16  // Times the client API resends a request refused as BUSY before giving up
+#define CLIENT_BACKOFF_MIN_US 1000  // First wait of the client API after a BUSY, doubled on every retry
+#define CLIENT_BACKOFF_MAX_US 1000000
@@ -0,0 +1,225 @@
+#include "protocol.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constants.h"
+
+int write_all(int fd, const void *buf, size_t len) {
+  const char *data = buf;
+  while (len > 0) {
+    ssize_t written = write(fd, data, len);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+
+    data += (size_t)written;
+    len -= (size_t)written;
+  }
+
+  return 0;
+}
+
+int read_all(int fd, void *buf, size_t len) {
+  char *data = buf;
+  while (len > 0) {
+    ssize_t read_bytes = read(fd, data, len);
+    if (read_bytes == -1) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+    if (read_bytes == 0) {
+      return 1;
+    }
+
+    data += (size_t)read_bytes;
+    len -= (size_t)read_bytes;
+  }
+
+  return 0;
+}
+
+int send_message(int fd, const char *text) {
+  char msg[TAMMSG] = {0};
+  size_t len = strlen(text);
+  if (len >= TAMMSG) {
+    return 1;
+  }
+
+  memcpy(msg, text, len);
+  return write_all(fd, msg, TAMMSG);
+}
+
+int receive_message(int fd, char msg[TAMMSG]) {
+  if (read_all(fd, msg, TAMMSG)) {
+    return 1;
+  }
+
+  msg[TAMMSG - 1] = '\0';
+  return 0;
+}
+
+size_t split_message(char *msg, char *fields[], size_t max_fields) {
+  size_t count = 0;
+  char *saveptr = NULL;
+
+  for (char *token = strtok_r(msg, "|", &saveptr); token != NULL && count < max_fields;
+       token = strtok_r(NULL, "|", &saveptr)) {
+    fields[count++] = token;
+  }
+
+  return count;
+}
+
+int message_op_code(const char *field) {
+  const char prefix[] = "OP_CODE=";
+  if (strncmp(field, prefix, sizeof(prefix) - 1) != 0) {
+    return -1;
+  }
+
+  char *endptr;
+  long code = strtol(field + sizeof(prefix) - 1, &endptr, 10);
+  if (*endptr != '\0' || code < 0 || code > 99) {
+    return -1;
+  }
+
+  return (int)code;
+}
+
+void format_reply_header(char header[TAMMSG], int ret, size_t payload_len) {
+  memset(header, 0, TAMMSG);
+  snprintf(header, TAMMSG, "%d|%zu", ret, payload_len);
+}
+
+void format_stream_header(char header[TAMMSG], int ret, size_t lines) {
+  memset(header, 0, TAMMSG);
+  snprintf(header, TAMMSG, "%d|*|%zu", ret, lines);
+}
+
+int receive_reply_header(int fd, int *ret, size_t *size, int *streamed) {
+  char header[TAMMSG];
+  if (receive_message(fd, header)) {
+    return 1;
+  }
+
+  char *fields[3];
+  size_t num_fields = split_message(header, fields, 3);
+  *streamed = num_fields == 3 && strcmp(fields[1], "*") == 0;
+  if (num_fields != 2 && !*streamed) {
+    return 1;
+  }
+
+  *ret = atoi(fields[0]);
+  *size = strtoul(fields[num_fields - 1], NULL, 10);
+  return 0;
+}
+
+/// Reads the size of the next chunk of a streamed payload.
+/// @return 0 if the size was read, 1 otherwise.
+static int read_chunk_size(int fd, size_t *size) {
+  uint32_t chunk_size;
+  if (read_all(fd, &chunk_size, sizeof(chunk_size))) {
+    return 1;
+  }
+
+  *size = chunk_size;
+  return 0;
+}
+
+int copy_reply_payload(int fd, int streamed, size_t size, int out_fd) {
+  char buf[STREAM_CHUNK_SIZE];
+
+  // A plain payload is copied as a single chunk of its whole size
+  size_t remaining = size;
+  if (streamed && read_chunk_size(fd, &remaining)) {
+    return 1;
+  }
+
+  // Once out_fd fails the rest of the payload is still read, so that the next reply can be received
+  int failed = 0;
+  while (remaining > 0) {
+    size_t len = remaining < sizeof(buf) ? remaining : sizeof(buf);
+    if (read_all(fd, buf, len)) {
+      return 1;
+    }
+    if (!failed && out_fd >= 0 && write_all(out_fd, buf, len)) {
+      failed = 1;
+    }
+
+    remaining -= len;
+    if (remaining == 0 && streamed && read_chunk_size(fd, &remaining)) {
+      return 1;
+    }
+  }
+
+  return failed;
+}
+
+/// Collects a streamed payload.
+/// @return 0 if the payload was received, 1 otherwise.
+static int receive_stream(int fd, char **payload, size_t *payload_len) {
+  size_t capacity = 0, chunk_size;
+  *payload_len = 0;
+
+  while (1) {
+    if (read_chunk_size(fd, &chunk_size)) {
+      return 1;
+    }
+    if (chunk_size == 0) {
+      return 0;
+    }
+
+    if (*payload_len + chunk_size > capacity) {
+      capacity = 2 * (*payload_len + chunk_size);
+      char *data = realloc(*payload, capacity);
+      if (data == NULL) {
+        return 1;
+      }
+      *payload = data;
+    }
+
+    if (read_all(fd, *payload + *payload_len, chunk_size)) {
+      return 1;
+    }
+    *payload_len += chunk_size;
+  }
+}
+
+int receive_reply_payload(int fd, int streamed, size_t size, char **payload, size_t *payload_len) {
+  *payload = NULL;
+  *payload_len = size;
+  if (streamed) {
+    if (receive_stream(fd, payload, payload_len)) {
+      free(*payload);
+      *payload = NULL;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (*payload_len == 0) {
+    return 0;
+  }
+
+  *payload = malloc(*payload_len);
+  if (*payload == NULL || read_all(fd, *payload, *payload_len)) {
+    free(*payload);
+    *payload = NULL;
+    return 1;
+  }
+
+  return 0;
+}
+
+int receive_reply(int fd, int *ret, char **payload, size_t *payload_len) {
+  int streamed;
+  if (receive_reply_header(fd, ret, payload_len, &streamed)) {
+    return 1;
+  }
+
+  return receive_reply_payload(fd, streamed, *payload_len, payload, payload_len);
+}
@@ -0,0 +1,180 @@
+#ifndef COMMON_PROTOCOL_H
+#define COMMON_PROTOCOL_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+
+// Messages must be written atomically: SETUPs of different clients share the server pipe, and the async server reads a
+// request as soon as poll finds its pipe readable, assuming the whole message is already there
+_Static_assert(TAMMSG <= PIPE_BUF, "TAMMSG must be at most PIPE_BUF so that messages are written atomically");
+
+/// Operation codes of the requests.
+/// @note A request is a TAMMSG message "OP_CODE=<code>|<field>|<field>...", padded with '\0':
+///   SETUP   <request pipe>|<response pipe>[|<session class>]
+///                 (sent to the server pipe, answered with the session id as an int; the class defaults to NORMAL. A
+///                 server with no room for the session answers SESSION_BUSY followed by a retry-after int)
+///   QUIT                                    (not answered)
+///   CREATE  <event_id>|<num_rows>|<num_cols>
+///   RESERVE <event_id>|<num_seats>|[<x1> <x2> ...]|[<y1> <y2> ...]
+///   SHOW    <event_id>
+///   LIST    [<after_id>|<limit>|<filters>|<occupancy>|<min seats>|<max seats>]
+///                 (without fields, every event; with them, a page of at most limit events with ids greater than
+///                 after_id that pass the filters, in id order, as "Event: <id> (<rows>x<cols>, <free> free)" lines)
+///   RESERVE_MULTI <event_id>|<num_groups>|[<n1> <n2> ...]|[<x1> <x2> ...]|[<y1> <y2> ...]
+///                 (the seats of each reservation follow those of the previous one; the payload has the result of
+///                 each reservation as an int, 0 if it was created)
+///   RESERVE_RANGES <event_id>|<num_ranges>|[<r1>-<r2> ...]|[<c1>-<c2> ...]
+///                 (one reservation of every seat in rows r1..r2 and columns c1..c2 of each range; "<r>" is "<r>-<r>")
+///   STATS   <event_id>
+///                 (the free seats of the event and of each of its rows, with the longest run of free seats of each
+///                 row, from counters kept by the reservations)
+///   DELETE  <event_id>|<archive>
+///                 (releases the event and its seats; with archive 1, its final state is first written to the archive
+///                 directory of the server, and the event is kept if that fails)
+/// Every other request is answered with a TAMMSG header "<ret>|<payload size>" followed by the payload bytes. An
+/// overloaded server answers REPLY_BUSY with a retry-after int as the payload, without executing the request.
+/// A successful SHOW or LIST is streamed instead: its header is "<ret>|*|<lines>", followed by chunks of a uint32_t
+/// size and that many bytes, the last chunk being empty. The lines of a LIST are counted when it starts, so events
+/// deleted while it is sent can make it shorter.
+enum OpCode {
+  OP_SETUP = 1,
+  OP_QUIT = 2,
+  OP_CREATE = 3,
+  OP_RESERVE = 4,
+  OP_SHOW = 5,
+  OP_LIST = 6,
+  OP_RESERVE_MULTI = 7,
+  OP_RESERVE_RANGES = 8,
+  OP_STATS = 9,
+  OP_DELETE = 10,
+};
+
+/// Return value of a request refused because the server is overloaded, which can be sent again as it is.
+#define REPLY_BUSY 2
+
+/// Session id a SETUP is answered with when the server has no room for the session.
+#define SESSION_BUSY (-2)
+
+/// Scheduling class of a session, requested in its SETUP.
+/// @note The async server serves the PRIORITY sessions (admin and box-office clients) ahead of the NORMAL ones, in
+/// bounded bursts so that the NORMAL sessions are never starved.
+enum SessionClass {
+  SESSION_CLASS_NORMAL = 0,
+  SESSION_CLASS_PRIORITY = 1,
+  SESSION_CLASS_COUNT  // Number of classes
+};
+
+/// A block of seats: rows first_row to last_row of columns first_col to last_col, all inclusive and starting at 1.
+struct SeatRange {
+  size_t first_row;
+  size_t last_row;
+  size_t first_col;
+  size_t last_col;
+};
+
+/// Filters of a LIST query, combined as a bitmask.
+enum ListFilter {
+  LIST_FILTER_FREE = 1,       /// Events with a free seat.
+  LIST_FILTER_OCCUPANCY = 2,  /// Events with more than a percentage of their seats taken.
+  LIST_FILTER_SIZE = 4,       /// Events with a number of seats in a range.
+};
+
+/// A page of a LIST query.
+/// @note The last id of a page is the after_id of the next one.
+struct ListQuery {
+  unsigned int after_id;   /// Only events with greater ids, 0 for the first page.
+  size_t limit;            /// Most events listed, up to LIST_PAGE_MAX; 0 for LIST_PAGE_MAX.
+  unsigned int filters;    /// Bitmask of ListFilter.
+  unsigned int occupancy;  /// Percentage of LIST_FILTER_OCCUPANCY.
+  size_t min_seats;        /// Smallest number of seats of LIST_FILTER_SIZE.
+  size_t max_seats;        /// Largest number of seats of LIST_FILTER_SIZE.
+};
+
+/// Writes a whole buffer, retrying on partial writes.
+/// @param fd File descriptor to write to.
+/// @param buf Data to write.
+/// @param len Number of bytes to write.
+/// @return 0 if everything was written, 1 otherwise.
+int write_all(int fd, const void *buf, size_t len);
+
+/// Reads exactly len bytes, retrying on partial reads.
+/// @param fd File descriptor to read from.
+/// @param buf Buffer to read into.
+/// @param len Number of bytes to read.
+/// @return 0 if everything was read, 1 on error or end of file.
+int read_all(int fd, void *buf, size_t len);
+
+/// Sends a message padded to TAMMSG bytes.
+/// @param fd File descriptor to write to.
+/// @param text Contents of the message.
+/// @return 0 if the message was sent, 1 if it does not fit in TAMMSG or could not be written.
+int send_message(int fd, const char *text);
+
+/// Receives a TAMMSG message.
+/// @param fd File descriptor to read from.
+/// @param msg Buffer to store the message in, always '\0' terminated.
+/// @return 0 if a message was received, 1 on error or end of file.
+int receive_message(int fd, char msg[TAMMSG]);
+
+/// Splits a message into its fields, in place.
+/// @param msg Message to split.
+/// @param fields Array to store the fields in.
+/// @param max_fields Size of fields.
+/// @return Number of fields found, at most max_fields.
+size_t split_message(char *msg, char *fields[], size_t max_fields);
+
+/// Gets the operation code of the first field of a request.
+/// @param field First field of the request.
+/// @return The operation code, -1 if the field is not "OP_CODE=<code>".
+int message_op_code(const char *field);
+
+/// Formats the header of a reply.
+/// @param header Buffer to store the header in.
+/// @param ret Return value of the operation.
+/// @param payload_len Number of bytes following the header.
+void format_reply_header(char header[TAMMSG], int ret, size_t payload_len);
+
+/// Formats the header of a streamed reply.
+/// @param header Buffer to store the header in.
+/// @param ret Return value of the operation.
+/// @param lines Number of lines of the streamed payload.
+void format_stream_header(char header[TAMMSG], int ret, size_t lines);
+
+/// Receives the header of a reply, leaving its payload to be read.
+/// @param fd File descriptor to read from.
+/// @param ret Pointer to store the return value of the operation in.
+/// @param size Pointer to store the size of the payload in, or the number of lines of a streamed payload.
+/// @param streamed Pointer to store whether the payload is streamed in chunks.
+/// @return 0 if the header was received, 1 otherwise.
+int receive_reply_header(int fd, int *ret, size_t *size, int *streamed);
+
+/// Copies the payload of a reply whose header was received, without holding more than a chunk of it in memory.
+/// @param fd File descriptor to read from.
+/// @param streamed Whether the payload is streamed in chunks.
+/// @param size Size of the payload, ignored if it is streamed.
+/// @param out_fd File descriptor to write the payload to, -1 to discard it.
+/// @return 0 if the payload was copied, 1 otherwise.
+int copy_reply_payload(int fd, int streamed, size_t size, int out_fd);
+
+/// Receives the payload of a reply whose header was received, collecting a streamed payload in full.
+/// @param fd File descriptor to read from.
+/// @param streamed Whether the payload is streamed in chunks.
+/// @param size Size of the payload, ignored if it is streamed.
+/// @param payload Pointer to store the payload in, NULL if it is empty. Must be released with free.
+/// @param payload_len Pointer to store the size of the payload in.
+/// @return 0 if the payload was received, 1 otherwise.
+int receive_reply_payload(int fd, int streamed, size_t size, char **payload, size_t *payload_len);
+
+/// Receives a reply.
+/// @note A streamed payload is collected in full.
+/// @param fd File descriptor to read from.
+/// @param ret Pointer to store the return value of the operation in.
+/// @param payload Pointer to store the payload in, NULL if it is empty. Must be released with free.
+/// @param payload_len Pointer to store the size of the payload in.
+/// @return 0 if the reply was received, 1 otherwise.
+int receive_reply(int fd, int *ret, char **payload, size_t *payload_len);
+
+#endif  // COMMON_PROTOCOL_H
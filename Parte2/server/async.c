@@ -0,0 +1,570 @@
+#include "async.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "common/constants.h"
+#include "common/protocol.h"
+#include "operations.h"
+#include "placement.h"
+#include "requests.h"
+#include "stats.h"
+#include "trace.h"
+
+/// Where the continuation of a session is parked.
+enum SessionState {
+  SESSION_IDLE,      /// Waiting for the next request on the request pipe.
+  SESSION_READY,     /// In the run queue.
+  SESSION_RUNNING,   /// Being run by an executor, or being connected.
+  SESSION_SLEEPING,  /// In the timer queue, waiting for the state access delay.
+  SESSION_WRITING,   /// Waiting for the response pipe to accept the rest of the reply.
+};
+
+/// Next step of the continuation of a request.
+enum RequestStep {
+  STEP_ACCESS,  /// Decide whether the state access delay has to be waited for.
+  STEP_APPLY,   /// Execute the operation and build the reply.
+  STEP_REPLY,   /// Write the rest of the reply.
+};
+
+struct AsyncSession {
+  int id;
+  int req_fd;   /// Non-blocking, only read once poll finds a request in it.
+  int resp_fd;  /// Non-blocking, so that a full pipe parks the session instead of an executor.
+  enum SessionState state;
+
+  enum RequestStep step;
+  struct Request request;
+  enum StatsOp stats_op;  /// Statistics bucket of the request.
+  uint64_t started;       /// Timestamp of the request returned by stats_begin.
+  uint64_t wake_us;       /// When a SLEEPING session becomes ready.
+  struct Buffer reply;
+  size_t sent;                /// Bytes of the reply already written.
+  struct ReplyStream stream;  /// Chunks of a LIST or SHOW still to be built once the reply is written.
+
+  unsigned int node;  /// Node whose executors run the continuation: the home node of the event of the request.
+  enum SessionClass session_class;  /// Lane of the run queues the session waits in.
+  size_t charge;   /// Cost of the request not yet paid for, 0 once it has started running.
+  size_t deficit;  /// Quanta given to the request while it waited for its cost to be covered.
+  struct AsyncSession* next_ready;
+};
+
+/// FIFO of the sessions of one class in a run queue.
+struct Lane {
+  struct AsyncSession* head;
+  struct AsyncSession* tail;
+  size_t length;
+};
+
+/// Run queue of the executors of a node.
+struct RunQueue {
+  struct Lane lanes[SESSION_CLASS_COUNT];
+  unsigned int priority_streak;  // PRIORITY requests started in a row while NORMAL sessions waited
+  pthread_cond_t cond;
+};
+
+static struct {
+  pthread_mutex_t mutex;
+  struct AsyncSession* sessions[ASYNC_MAX_SESSIONS];  // Indexed by session id, NULL if the id is free
+  struct RunQueue ready[MAX_PLACEMENT_NODES];         // Run queue of each node
+  struct AsyncSession* timers[ASYNC_MAX_SESSIONS];  // Min-heap on wake_us; a session has one request at a time
+  size_t num_timers;
+  size_t poll_rotation;  // First session id polled by the loop, moved on every iteration so no id is always first
+  uint64_t run_us;               // Moving average of the time an executor takes to run a continuation
+  unsigned int node_executors;  // Executor threads of each node
+  int wake_fds[2];  // Self-pipe that interrupts poll when a session is parked
+  int trace_pending;  // Whether a session ended since the loop last flushed the trace
+} server = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/// Adds a session to the timer queue.
+/// @note Must be called with the server mutex held.
+static void timer_push(struct AsyncSession* session) {
+  size_t i = server.num_timers++;
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (server.timers[parent]->wake_us <= session->wake_us) break;
+    server.timers[i] = server.timers[parent];
+    i = parent;
+  }
+  server.timers[i] = session;
+}
+
+/// Removes the session that wakes up first from the timer queue.
+/// @note Must be called with the server mutex held and the queue not empty.
+static struct AsyncSession* timer_pop(void) {
+  struct AsyncSession* top = server.timers[0];
+  struct AsyncSession* last = server.timers[--server.num_timers];
+
+  size_t i = 0;
+  while (server.num_timers > 0) {
+    size_t child = 2 * i + 1;
+    if (child >= server.num_timers) break;
+    if (child + 1 < server.num_timers && server.timers[child + 1]->wake_us < server.timers[child]->wake_us) child++;
+    if (last->wake_us <= server.timers[child]->wake_us) break;
+    server.timers[i] = server.timers[child];
+    i = child;
+  }
+  if (server.num_timers > 0) server.timers[i] = last;
+
+  return top;
+}
+
+static void lane_push(struct Lane* lane, struct AsyncSession* session) {
+  session->next_ready = NULL;
+  if (lane->tail != NULL) {
+    lane->tail->next_ready = session;
+  } else {
+    lane->head = session;
+  }
+  lane->tail = session;
+  lane->length++;
+}
+
+static struct AsyncSession* lane_pop(struct Lane* lane) {
+  struct AsyncSession* session = lane->head;
+  lane->head = session->next_ready;
+  if (lane->head == NULL) lane->tail = NULL;
+  lane->length--;
+  return session;
+}
+
+/// Adds a session to the run queue of its node.
+/// @note Must be called with the server mutex held.
+static void make_ready(struct AsyncSession* session) {
+  struct RunQueue* queue = &server.ready[session->node];
+  session->state = SESSION_READY;
+  lane_push(&queue->lanes[session->session_class], session);
+  pthread_cond_signal(&queue->cond);
+}
+
+/// Takes the next session to run from a run queue, by deficit round robin within each lane.
+/// @note Must be called with the server mutex held and the queue not empty. Each time a request that has not started
+/// comes to the head of its lane it gets ASYNC_DRR_QUANTUM; if that does not cover its cost yet, it goes back to the
+/// tail, so an expensive request waits for the cheap ones queued behind it instead of holding them up. The PRIORITY
+/// lane goes first, but for no more than ASYNC_PRIORITY_BURST requests in a row while NORMAL sessions are waiting.
+/// @param queue Run queue of the executor.
+/// @return The session, taken out of the queue.
+static struct AsyncSession* next_session(struct RunQueue* queue) {
+  struct Lane* normal = &queue->lanes[SESSION_CLASS_NORMAL];
+  struct Lane* priority = &queue->lanes[SESSION_CLASS_PRIORITY];
+
+  while (1) {
+    int from_priority =
+        priority->head != NULL && (normal->head == NULL || queue->priority_streak < ASYNC_PRIORITY_BURST);
+    struct Lane* lane = from_priority ? priority : normal;
+    struct AsyncSession* session = lane_pop(lane);
+
+    if (session->charge > 0) {
+      session->deficit += ASYNC_DRR_QUANTUM;
+      if (session->charge > session->deficit) {
+        lane_push(lane, session);
+        continue;
+      }
+      session->charge = 0;
+    }
+
+    queue->priority_streak = from_priority ? queue->priority_streak + 1 : 0;
+    return session;
+  }
+}
+
+/// Estimates how long the executors of a node take to run a number of continuations.
+/// @note Must be called with the server mutex held.
+/// @param waiting Number of continuations.
+/// @return Suggested wait before retrying a request refused as BUSY, in milliseconds.
+static int busy_retry_after_ms(size_t waiting) {
+  uint64_t wait_ms = waiting * server.run_us / server.node_executors / 1000;
+  return wait_ms > BUSY_RETRY_MIN_MS ? (int)(wait_ms < INT_MAX ? wait_ms : INT_MAX) : BUSY_RETRY_MIN_MS;
+}
+
+/// Interrupts poll, so that the loop picks up the sessions parked since it started waiting.
+static void wake_loop(void) {
+  char byte = 0;
+  if (write(server.wake_fds[1], &byte, 1) == -1 && errno != EAGAIN) {
+    perror("write - async wake pipe");
+  }
+}
+
+/// Parks the continuation of a session until the loop resumes it.
+/// @param session Session to park, currently RUNNING.
+/// @param state SESSION_IDLE, SESSION_SLEEPING or SESSION_WRITING.
+static void park(struct AsyncSession* session, enum SessionState state) {
+  pthread_mutex_lock(&server.mutex);
+  session->state = state;
+  if (state == SESSION_SLEEPING) timer_push(session);
+  pthread_mutex_unlock(&server.mutex);
+  wake_loop();
+}
+
+/// Closes a session and releases its id.
+/// @note Must be called with the server mutex held, by the only thread that owns the session in its current state.
+static void close_session(struct AsyncSession* session) {
+  server.sessions[session->id] = NULL;
+  free_Session(session->id);
+
+  close(session->req_fd);
+  close(session->resp_fd);
+  buffer_free(&session->reply);
+  stream_free(&session->stream);
+  free(session);
+
+  // The trace is flushed by the loop, outside the server mutex
+  server.trace_pending = 1;
+  wake_loop();
+}
+
+/// Runs the continuation of a session until it finishes the request or has to wait.
+/// @param session Session to run, RUNNING.
+static void run_session(struct AsyncSession* session) {
+  if (session->step == STEP_ACCESS) {
+    session->step = STEP_APPLY;
+
+    // The delay is waited for on the timer queue, instead of by a sleeping thread inside the operation
+    unsigned int event_id;
+    unsigned int delay = ems_access_delay();
+    if (delay > 0 && request_event(&session->request, &event_id) && !ems_event_cached(event_id)) {
+      session->wake_us = now_us() + delay;
+      park(session, SESSION_SLEEPING);
+      return;
+    }
+  }
+
+  if (session->step == STEP_APPLY) {
+    session->step = STEP_REPLY;
+    session->sent = 0;
+
+    if (execute_request(&session->request, &session->reply, &session->stream) != 0) {
+      fprintf(stderr, "Failed to build reply\n");
+      stats_end(session->stats_op, session->started);
+      pthread_mutex_lock(&server.mutex);
+      close_session(session);
+      pthread_mutex_unlock(&server.mutex);
+      return;
+    }
+  }
+
+  while (session->sent < session->reply.len) {
+    ssize_t written =
+        write(session->resp_fd, session->reply.data + session->sent, session->reply.len - session->sent);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        park(session, SESSION_WRITING);
+        return;
+      }
+
+      // The client went away
+      stats_end(session->stats_op, session->started);
+      pthread_mutex_lock(&server.mutex);
+      close_session(session);
+      pthread_mutex_unlock(&server.mutex);
+      return;
+    }
+
+    session->sent += (size_t)written;
+  }
+
+  if (session->stream.pending) {
+    session->reply.len = 0;
+    session->sent = 0;
+    if (stream_next(&session->stream, &session->reply) != 0) {
+      fprintf(stderr, "Failed to build reply\n");
+      stats_end(session->stats_op, session->started);
+      pthread_mutex_lock(&server.mutex);
+      close_session(session);
+      pthread_mutex_unlock(&server.mutex);
+      return;
+    }
+
+    // Each chunk is a continuation of its own, so a long reply takes turns with the other sessions
+    pthread_mutex_lock(&server.mutex);
+    session->charge = 1;
+    session->deficit = 0;
+    make_ready(session);
+    pthread_mutex_unlock(&server.mutex);
+    return;
+  }
+
+  stats_end(session->stats_op, session->started);
+  buffer_free(&session->reply);
+  park(session, SESSION_IDLE);
+}
+
+/// Executor thread: runs the continuations in the run queue of its node.
+/// @param arg Index of the node, which the thread is pinned to.
+/// @return NULL.
+static void* executor_thread(void* arg) {
+  struct RunQueue* queue = &server.ready[(size_t)arg];
+  placement_pin((unsigned int)(size_t)arg);
+  uint64_t ran_us = 0;  // Time taken by the last continuation, folded into the average with the lock held anyway
+
+  while (1) {
+    pthread_mutex_lock(&server.mutex);
+    if (ran_us > 0) server.run_us = (server.run_us * 7 + ran_us) / 8;
+    while (queue->lanes[SESSION_CLASS_NORMAL].head == NULL && queue->lanes[SESSION_CLASS_PRIORITY].head == NULL) {
+      pthread_cond_wait(&queue->cond, &server.mutex);
+    }
+
+    struct AsyncSession* session = next_session(queue);
+    session->state = SESSION_RUNNING;
+    pthread_mutex_unlock(&server.mutex);
+
+    uint64_t start = now_us();
+    run_session(session);
+    ran_us = now_us() - start + 1;
+  }
+
+  return NULL;
+}
+
+/// Answers the request of a session without executing it, through the same continuation as any other reply.
+/// @note Must be called with the server mutex held.
+/// @param session Session to answer, its request already received.
+/// @param ret Return value of the reply.
+/// @param payload Payload of the reply.
+/// @param payload_len Size of the payload.
+/// @param stats_op Statistics bucket of the request.
+static void reply_unexecuted(struct AsyncSession* session, int ret, const void* payload, size_t payload_len,
+                             enum StatsOp stats_op) {
+  char header[TAMMSG];
+  format_reply_header(header, ret, payload_len);
+  session->stats_op = stats_op;
+  session->step = STEP_REPLY;
+  session->sent = 0;
+  if (buffer_append(&session->reply, header, TAMMSG) != 0 ||
+      buffer_append(&session->reply, payload, payload_len) != 0) {
+    stats_end(stats_op, session->started);
+    close_session(session);
+    return;
+  }
+  make_ready(session);
+}
+
+/// Reads the next request of an idle session and starts its continuation.
+/// @note Must be called with the server mutex held, when the request pipe is readable. Clients write whole messages
+/// of TAMMSG <= PIPE_BUF bytes, so a readable pipe holds a full request.
+/// @param session Session to read from, IDLE.
+static void read_request(struct AsyncSession* session) {
+  char msg[TAMMSG];
+  if (receive_message(session->req_fd, msg)) {
+    close_session(session);  // The client closed its request pipe without sending QUIT
+    return;
+  }
+
+  session->started = stats_begin();
+  trace_record(session->id, msg);
+  session->node = (unsigned int)session->id % placement_nodes();
+  session->charge = 1;
+  session->deficit = 0;
+
+  if (parse_request(msg, &session->request) != 0) {
+    reply_unexecuted(session, 1, NULL, 0, STATS_OP_COUNT);
+    return;
+  }
+
+  if (session->request.op == OP_QUIT) {
+    stats_end(STATS_OP_QUIT, session->started);
+    close_session(session);
+    return;
+  }
+
+  unsigned int event_id;
+  if (request_event(&session->request, &event_id)) session->node = placement_event_node(event_id);
+
+  // Shedding here keeps the wait of the requests that are accepted bounded; PRIORITY sessions are never refused
+  size_t waiting = server.ready[session->node].lanes[SESSION_CLASS_NORMAL].length;
+  if (session->session_class == SESSION_CLASS_NORMAL && waiting >= ASYNC_QUEUE_LIMIT) {
+    // Coming back once the queue has drained, rather than as soon as it has room, keeps retries from piling up on it
+    int retry_after_ms = busy_retry_after_ms(waiting);
+    reply_unexecuted(session, REPLY_BUSY, &retry_after_ms, sizeof(retry_after_ms), STATS_OP_BUSY);
+    return;
+  }
+
+  session->stats_op = request_stats_op(&session->request);
+  session->charge = request_cost(&session->request);
+  session->step = STEP_ACCESS;
+  make_ready(session);
+}
+
+/// Accepts a SETUP request from the server pipe.
+/// @param server_fd File descriptor of the server pipe, readable.
+/// @return 0 if the server pipe is still usable, 1 otherwise.
+static int accept_session(int server_fd) {
+  char msg[TAMMSG];
+  if (receive_message(server_fd, msg)) {
+    perror("read");
+    return 1;
+  }
+
+  uint64_t start = stats_begin();
+  char req_pipe_path[PATH_MAX], resp_pipe_path[PATH_MAX];
+  enum SessionClass session_class;
+  if (parse_setup(msg, req_pipe_path, resp_pipe_path, &session_class) != 0) {
+    fprintf(stderr, "Invalid setup request\n");
+    stats_end(STATS_OP_COUNT, start);
+    return 0;
+  }
+
+  struct AsyncSession* session = calloc(1, sizeof(struct AsyncSession));
+  if (session == NULL) {
+    fprintf(stderr, "Error allocating memory for session\n");
+    stats_end(STATS_OP_COUNT, start);
+    return 0;
+  }
+  buffer_init(&session->reply);
+  stream_init(&session->stream);
+  session->state = SESSION_RUNNING;  // Not polled until it is connected
+  session->session_class = session_class;
+  session->id = -1;
+
+  pthread_mutex_lock(&server.mutex);
+  for (int id = 0; id < ASYNC_MAX_SESSIONS && session->id == -1; id++) {
+    if (server.sessions[id] == NULL) {
+      session->id = id;
+      server.sessions[id] = session;
+    }
+  }
+  pthread_mutex_unlock(&server.mutex);
+
+  if (session->id == -1) {
+    // Every session has to finish its current request before one can end and free an id
+    pthread_mutex_lock(&server.mutex);
+    int retry_after_ms = busy_retry_after_ms(ASYNC_MAX_SESSIONS);
+    pthread_mutex_unlock(&server.mutex);
+
+    fprintf(stderr, "Too many sessions\n");
+    reject_session(resp_pipe_path, retry_after_ms);
+    free(session);
+    stats_end(STATS_OP_BUSY, start);
+    return 0;
+  }
+
+  // Neither pipe is waited for: until the client opens its request pipe, the session is polled but never readable
+  if (connect_session(session->id, req_pipe_path, resp_pipe_path, &session->req_fd, &session->resp_fd, 1) != 0) {
+    pthread_mutex_lock(&server.mutex);
+    server.sessions[session->id] = NULL;
+    pthread_mutex_unlock(&server.mutex);
+    free(session);
+    stats_end(STATS_OP_COUNT, start);
+    return 0;
+  }
+
+  trace_setup(session->id, req_pipe_path, resp_pipe_path);
+  store_session_details(session->id, req_pipe_path, resp_pipe_path);
+  park(session, SESSION_IDLE);
+  stats_end(STATS_OP_SETUP, start);
+  return 0;
+}
+
+int serve_async(int server_fd, unsigned int num_threads) {
+  ems_defer_access_delay();
+
+  if (pipe(server.wake_fds) != 0 || fcntl(server.wake_fds[0], F_SETFL, O_NONBLOCK) == -1 ||
+      fcntl(server.wake_fds[1], F_SETFL, O_NONBLOCK) == -1) {
+    perror("pipe - async wake pipe");
+    return 1;
+  }
+
+  unsigned int nodes = placement_nodes();
+  for (unsigned int n = 0; n < nodes; n++) pthread_cond_init(&server.ready[n].cond, NULL);
+  server.node_executors = num_threads / nodes;
+
+  for (unsigned int t = 0; t < num_threads; t++) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, executor_thread, (void*)(size_t)(t % nodes)) != 0) {
+      fprintf(stderr, "Failed to create executor thread\n");
+      return 1;
+    }
+    pthread_detach(tid);
+  }
+
+  struct pollfd fds[2 + ASYNC_MAX_SESSIONS];
+  struct AsyncSession* polled[2 + ASYNC_MAX_SESSIONS];
+
+  while (1) {
+    nfds_t nfds = 0;
+    fds[nfds++] = (struct pollfd){.fd = server_fd, .events = POLLIN};
+    fds[nfds++] = (struct pollfd){.fd = server.wake_fds[0], .events = POLLIN};
+
+    pthread_mutex_lock(&server.mutex);
+    size_t first = server.poll_rotation++ % ASYNC_MAX_SESSIONS;
+    for (size_t i = 0; i < ASYNC_MAX_SESSIONS; i++) {
+      struct AsyncSession* session = server.sessions[(first + i) % ASYNC_MAX_SESSIONS];
+      if (session == NULL) continue;
+
+      if (session->state == SESSION_IDLE) {
+        fds[nfds] = (struct pollfd){.fd = session->req_fd, .events = POLLIN};
+      } else if (session->state == SESSION_WRITING) {
+        fds[nfds] = (struct pollfd){.fd = session->resp_fd, .events = POLLOUT};
+      } else {
+        continue;
+      }
+      polled[nfds++] = session;
+    }
+
+    int timeout_ms = -1;
+    if (server.num_timers > 0) {
+      uint64_t now = now_us();
+      uint64_t wake = server.timers[0]->wake_us;
+      timeout_ms = wake > now ? (int)((wake - now + 999) / 1000) : 0;
+    }
+    pthread_mutex_unlock(&server.mutex);
+
+    if (poll(fds, nfds, timeout_ms) == -1) {
+      if (errno == EINTR) continue;
+      perror("poll");
+      return 1;
+    }
+
+    pthread_mutex_lock(&server.mutex);
+    if (fds[1].revents & POLLIN) {
+      char drain[64];
+      while (read(server.wake_fds[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+
+    uint64_t now = now_us();
+    while (server.num_timers > 0 && server.timers[0]->wake_us <= now) {
+      make_ready(timer_pop());
+    }
+
+    // Sessions parked in IDLE or WRITING are only resumed here, so they are still parked where they were polled
+    for (nfds_t i = 2; i < nfds; i++) {
+      if (fds[i].revents == 0) continue;
+
+      struct AsyncSession* session = polled[i];
+      if (session->state == SESSION_WRITING) {
+        make_ready(session);
+      } else {
+        read_request(session);
+      }
+    }
+
+    int flush = server.trace_pending;
+    server.trace_pending = 0;
+    pthread_mutex_unlock(&server.mutex);
+
+    // Makes the requests of the sessions that ended readable
+    if (flush) trace_flush();
+
+    if ((fds[0].revents & POLLIN) && accept_session(server_fd) != 0) {
+      return 1;
+    }
+  }
+}
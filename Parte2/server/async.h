@@ -0,0 +1,15 @@
+#ifndef SERVER_ASYNC_H
+#define SERVER_ASYNC_H
+
+/// Serves every session from a small pool of threads, without blocking a thread per session.
+/// @note Each request is a continuation that yields while it waits for the state access delay (on a timer queue) and
+/// while the client's response pipe is full (on a readiness queue). The calling thread polls the pipes and the timers;
+/// num_threads executor threads run the continuations that are ready, sharing them fairly between the sessions by the
+/// cost of their requests and serving the PRIORITY sessions first. With placement nodes, the executors are spread
+/// over the nodes and each request is run on the home node of its event.
+/// @param server_fd File descriptor of the server pipe.
+/// @param num_threads Number of executor threads, at least one per placement node.
+/// @return 1 if the server could not be started or reading the server pipe fails.
+int serve_async(int server_fd, unsigned int num_threads);
+
+#endif  // SERVER_ASYNC_H
@@ -0,0 +1,46 @@
+#include "buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void buffer_init(struct Buffer* buffer) {
+  buffer->data = NULL;
+  buffer->len = 0;
+  buffer->capacity = 0;
+}
+
+void buffer_free(struct Buffer* buffer) {
+  free(buffer->data);
+  buffer_init(buffer);
+}
+
+int buffer_append(struct Buffer* buffer, const void* data, size_t len) {
+  if (buffer->len + len > buffer->capacity) {
+    size_t capacity = buffer->capacity ? buffer->capacity : 256;
+    while (capacity < buffer->len + len) capacity *= 2;
+
+    char* grown = realloc(buffer->data, capacity);
+    if (grown == NULL) {
+      return 1;
+    }
+
+    buffer->data = grown;
+    buffer->capacity = capacity;
+  }
+
+  if (len > 0) {
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+  }
+
+  return 0;
+}
+
+int buffer_print_str(struct Buffer* buffer, const char* str) { return buffer_append(buffer, str, strlen(str)); }
+
+int buffer_print_uint(struct Buffer* buffer, unsigned int value) {
+  char digits[16];
+  int len = snprintf(digits, sizeof(digits), "%u", value);
+  return buffer_append(buffer, digits, (size_t)len);
+}
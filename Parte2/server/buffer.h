@@ -0,0 +1,40 @@
+#ifndef SERVER_BUFFER_H
+#define SERVER_BUFFER_H
+
+#include <stddef.h>
+
+/// Growable in-memory output, used to build a reply before it is sent.
+struct Buffer {
+  char* data;
+  size_t len;
+  size_t capacity;
+};
+
+/// Initializes an empty buffer.
+/// @param buffer Buffer to initialize.
+void buffer_init(struct Buffer* buffer);
+
+/// Releases the memory held by a buffer and leaves it empty.
+/// @param buffer Buffer to release.
+void buffer_free(struct Buffer* buffer);
+
+/// Appends bytes to a buffer.
+/// @param buffer Buffer to append to.
+/// @param data Bytes to append.
+/// @param len Number of bytes to append.
+/// @return 0 if the bytes were appended successfully, 1 otherwise.
+int buffer_append(struct Buffer* buffer, const void* data, size_t len);
+
+/// Appends a string to a buffer.
+/// @param buffer Buffer to append to.
+/// @param str String to append, without its terminator.
+/// @return 0 if the string was appended successfully, 1 otherwise.
+int buffer_print_str(struct Buffer* buffer, const char* str);
+
+/// Appends an unsigned integer in decimal to a buffer.
+/// @param buffer Buffer to append to.
+/// @param value Value to append.
+/// @return 0 if the value was appended successfully, 1 otherwise.
+int buffer_print_uint(struct Buffer* buffer, unsigned int value);
+
+#endif  // SERVER_BUFFER_H
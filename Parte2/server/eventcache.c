@@ -0,0 +1,155 @@
+#include "eventcache.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common/constants.h"
+#include "common/io.h"
+
+struct CacheEntry {
+  unsigned int id;      /// Id of the event, kept here so that a lookup never touches the events of other entries.
+  bool referenced;      /// Second chance bit of the CLOCK policy.
+  struct Event* event;  /// NULL if the slot is free.
+};
+
+#define EVENT_CACHE_SETS (EVENT_CACHE_SIZE / EVENT_CACHE_WAYS)
+
+/// Entries of the events whose ids hash to the set, with their own lock and CLOCK hand.
+/// @note Each set takes a cache line of its own, so that lookups of events in different sets share nothing.
+struct CacheSet {
+  alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;
+  struct CacheEntry entries[EVENT_CACHE_WAYS];
+  size_t hand;  // Next way to be considered for eviction
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
+static struct CacheSet sets[EVENT_CACHE_SETS];
+static pthread_once_t sets_once = PTHREAD_ONCE_INIT;
+
+static void init_sets(void) {
+  for (size_t s = 0; s < EVENT_CACHE_SETS; s++) pthread_mutex_init(&sets[s].mutex, NULL);
+}
+
+/// Gets the set of an event, with its lock held.
+/// @param event_id Id of the event.
+/// @return The set, to be unlocked by the caller.
+static struct CacheSet* lock_set(unsigned int event_id) {
+  pthread_once(&sets_once, init_sets);
+  struct CacheSet* set = &sets[((uint32_t)event_id * 2654435769u) >> 16 & (EVENT_CACHE_SETS - 1)];
+  pthread_mutex_lock(&set->mutex);
+  return set;
+}
+
+/// Finds the way of an event in its set.
+/// @note Must be called with the set mutex held.
+/// @param set Set of the event.
+/// @param event_id Id of the event to find.
+/// @return Index of the way, EVENT_CACHE_WAYS if the event is not cached.
+static size_t find_way(const struct CacheSet* set, unsigned int event_id) {
+  for (size_t i = 0; i < EVENT_CACHE_WAYS; i++) {
+    if (set->entries[i].event != NULL && set->entries[i].id == event_id) return i;
+  }
+
+  return EVENT_CACHE_WAYS;
+}
+
+struct Event* event_cache_get(unsigned int event_id) {
+  struct CacheSet* set = lock_set(event_id);
+
+  struct Event* event = NULL;
+  size_t way = find_way(set, event_id);
+  if (way < EVENT_CACHE_WAYS) {
+    set->entries[way].referenced = true;
+    event = set->entries[way].event;
+    set->hits++;
+  } else {
+    set->misses++;
+  }
+
+  pthread_mutex_unlock(&set->mutex);
+  return event;
+}
+
+int event_cache_contains(unsigned int event_id) {
+  struct CacheSet* set = lock_set(event_id);
+  int found = find_way(set, event_id) < EVENT_CACHE_WAYS;
+  pthread_mutex_unlock(&set->mutex);
+  return found;
+}
+
+void event_cache_put(struct Event* event) {
+  struct CacheSet* set = lock_set(event->id);
+
+  // Another thread may have fetched the same event in the meantime
+  if (find_way(set, event->id) < EVENT_CACHE_WAYS) {
+    pthread_mutex_unlock(&set->mutex);
+    return;
+  }
+
+  // Sweep the clock of the set, clearing reference bits, until a free or unreferenced way is found
+  struct CacheEntry* entries = set->entries;
+  while (entries[set->hand].event != NULL && entries[set->hand].referenced) {
+    entries[set->hand].referenced = false;
+    set->hand = (set->hand + 1) % EVENT_CACHE_WAYS;
+  }
+
+  if (entries[set->hand].event != NULL) set->evictions++;
+
+  entries[set->hand].id = event->id;
+  entries[set->hand].event = event;
+  entries[set->hand].referenced = true;
+  set->hand = (set->hand + 1) % EVENT_CACHE_WAYS;
+
+  pthread_mutex_unlock(&set->mutex);
+}
+
+void event_cache_invalidate(unsigned int event_id) {
+  struct CacheSet* set = lock_set(event_id);
+
+  size_t way = find_way(set, event_id);
+  if (way < EVENT_CACHE_WAYS) {
+    set->entries[way].event = NULL;
+    set->entries[way].referenced = false;
+  }
+
+  pthread_mutex_unlock(&set->mutex);
+}
+
+void event_cache_clear(void) {
+  pthread_once(&sets_once, init_sets);
+  for (size_t s = 0; s < EVENT_CACHE_SETS; s++) {
+    pthread_mutex_lock(&sets[s].mutex);
+    for (size_t i = 0; i < EVENT_CACHE_WAYS; i++) {
+      sets[s].entries[i].event = NULL;
+      sets[s].entries[i].referenced = false;
+    }
+    sets[s].hand = 0;
+    pthread_mutex_unlock(&sets[s].mutex);
+  }
+}
+
+int event_cache_print(int out_fd) {
+  pthread_once(&sets_once, init_sets);
+  uint64_t h = 0, m = 0, e = 0;
+  size_t used = 0;
+  for (size_t s = 0; s < EVENT_CACHE_SETS; s++) {
+    pthread_mutex_lock(&sets[s].mutex);
+    h += sets[s].hits;
+    m += sets[s].misses;
+    e += sets[s].evictions;
+    for (size_t i = 0; i < EVENT_CACHE_WAYS; i++) {
+      if (sets[s].entries[i].event != NULL) used++;
+    }
+    pthread_mutex_unlock(&sets[s].mutex);
+  }
+
+  char line[256];
+  snprintf(line, sizeof(line), "Event cache: %zu/%d entries, %lu hits, %lu misses, %lu evictions\n", used,
+           EVENT_CACHE_SIZE, (unsigned long)h, (unsigned long)m, (unsigned long)e);
+  return print_str(out_fd, line);
+}
@@ -0,0 +1,36 @@
+#ifndef SERVER_EVENT_CACHE_H
+#define SERVER_EVENT_CACHE_H
+
+#include "eventlist.h"
+
+/// Looks up an event in the cache.
+/// @note Counts a hit or a miss. Event slots are never freed while the EMS state is alive, so the pointer stays valid,
+/// but the event may be deleted and its slot reused once it is returned: callers check it under the event mutex.
+/// @param event_id Id of the event to look up.
+/// @return Pointer to the event if it is cached, NULL otherwise.
+struct Event* event_cache_get(unsigned int event_id);
+
+/// Checks whether an event is cached, without counting a hit or a miss.
+/// @param event_id Id of the event to check.
+/// @return 1 if the event is cached, 0 otherwise.
+int event_cache_contains(unsigned int event_id);
+
+/// Stores an event fetched from the state, evicting another one of its set with the CLOCK policy if the set is full.
+/// @note Events are placed by a hash of their id in sets of EVENT_CACHE_WAYS entries, each with its own lock, so
+/// threads looking up events of different sets never contend.
+/// @param event Event to store.
+void event_cache_put(struct Event* event);
+
+/// Drops the cached entry of an event, if any.
+/// @param event_id Id of the event to drop.
+void event_cache_invalidate(unsigned int event_id);
+
+/// Drops every cached entry, keeping the counters.
+void event_cache_clear(void);
+
+/// Writes the cache counters.
+/// @param out_fd File descriptor to write to.
+/// @return 0 if the counters were written successfully, 1 otherwise.
+int event_cache_print(int out_fd);
+
+#endif  // SERVER_EVENT_CACHE_H
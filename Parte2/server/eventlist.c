@@ -1,74 +1,210 @@
 #include "eventlist.h"
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define EVENT_INDEX_MIN_BITS 6  // 64 slots
 
 struct EventList* create_list() {
-  struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
+  struct EventList* list = (struct EventList*)calloc(1, sizeof(struct EventList));
   if (!list) return NULL;
   if (pthread_rwlock_init(&list->rwl, NULL) != 0) {
     free(list);
     return NULL;
   }
-  list->head = NULL;
-  list->tail = NULL;
   return list;
 }
 
-int append_to_list(struct EventList* list, struct Event* event) {
-  if (!list) return 1;
+/// Gets the first slot to probe for an event id (Fibonacci hashing, so that consecutive ids spread out).
+/// @note The slot comes from the top bits of the product: the low bits of ids that share a residue, such as the ids
+/// of one shard, would all land in the same fraction of the slots.
+static size_t slot_of(const struct EventList* list, unsigned int event_id) {
+  return (size_t)(((uint64_t)event_id * 11400714819323198485u) >> (64 - list->slot_bits));
+}
 
-  struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
-  if (!new_node) return 1;
+/// Adds an event to the index, which must have a free slot.
+static void index_event(struct EventList* list, unsigned int event_id, size_t position) {
+  size_t slot = slot_of(list, event_id);
+  while (list->slots[slot].position != 0) slot = (slot + 1) & (list->num_slots - 1);
 
-  new_node->event = event;
-  new_node->next = NULL;
+  list->slots[slot].id = event_id;
+  list->slots[slot].position = (unsigned int)position + 1;
+}
 
-  if (list->head == NULL) {
-    list->head = new_node;
-    list->tail = new_node;
-  } else {
-    list->tail->next = new_node;
-    list->tail = new_node;
+/// Doubles the index, so that it stays at most half full.
+/// @return 0 if the index was grown successfully, 1 otherwise.
+static int grow_index(struct EventList* list) {
+  unsigned int slot_bits = list->num_slots == 0 ? EVENT_INDEX_MIN_BITS : list->slot_bits + 1;
+  size_t num_slots = (size_t)1 << slot_bits;
+  struct EventSlot* slots = calloc(num_slots, sizeof(struct EventSlot));
+  if (!slots) return 1;
+
+  struct EventSlot* old = list->slots;
+  size_t old_slots = list->num_slots;
+  list->slots = slots;
+  list->num_slots = num_slots;
+  list->slot_bits = slot_bits;
+
+  for (size_t s = 0; s < old_slots; s++) {
+    if (old[s].position != 0) index_event(list, old[s].id, old[s].position - 1);
   }
 
+  free(old);
   return 0;
 }
 
-static void free_event(struct Event* event) {
-  if (!event) return;
-  free(event->data);
-  free(event);
+struct Event* append_to_list(struct EventList* list, unsigned int event_id, size_t rows, size_t cols,
+                             unsigned int* data) {
+  if (!list || (list->num_free == 0 && list->used >= UINT32_MAX)) return NULL;
+
+  if ((list->count + 1) * 2 > list->num_slots && grow_index(list) != 0) return NULL;
+
+  if (list->num_free == 0 && list->used == list->num_chunks * EVENT_SLAB_CHUNK) {
+    struct Event** chunks = realloc(list->chunks, (list->num_chunks + 1) * sizeof(struct Event*));
+    if (!chunks) return NULL;
+    list->chunks = chunks;
+
+    size_t capacity = (list->num_chunks + 1) * EVENT_SLAB_CHUNK;
+    struct EventSlot* ranks = realloc(list->ranks, capacity * sizeof(struct EventSlot));
+    if (!ranks) return NULL;
+    list->ranks = ranks;
+
+    unsigned int* free_positions = realloc(list->free_positions, capacity * sizeof(unsigned int));
+    if (!free_positions) return NULL;
+    list->free_positions = free_positions;
+
+    struct Event* chunk = aligned_alloc(CACHE_LINE_SIZE, EVENT_SLAB_CHUNK * sizeof(struct Event));
+    if (!chunk) return NULL;
+    list->chunks[list->num_chunks++] = chunk;
+  }
+
+  struct RowSummary* row_summaries = calloc(rows, sizeof(struct RowSummary));
+  if (rows > 0 && !row_summaries) return NULL;
+  for (size_t row = 0; row < rows; row++) {
+    row_summaries[row] = (struct RowSummary){.free_seats = cols, .longest_free = cols, .longest_start = 0};
+  }
+
+  size_t position;
+  struct Event* event;
+  if (list->num_free > 0) {
+    // A thread that looked the deleted event up may still be waiting on the mutex, which must stay as it is
+    position = list->free_positions[--list->num_free];
+    event = event_at(list, position);
+    pthread_mutex_lock(&event->mutex);
+  } else {
+    position = list->used;
+    event = event_at(list, position);
+    memset(event, 0, sizeof(struct Event));
+    if (pthread_mutex_init(&event->mutex, NULL) != 0) {
+      free(row_summaries);
+      return NULL;
+    }
+    pthread_mutex_lock(&event->mutex);
+    list->used++;
+  }
+
+  event->id = event_id;
+  event->rows = rows;
+  event->cols = cols;
+  event->data = data;
+  event->row_summaries = row_summaries;
+  event->reservations = 0;
+  event->free_seats = rows * cols;
+  event->deleted = 0;
+  pthread_mutex_unlock(&event->mutex);
+
+  index_event(list, event_id, position);
+
+  // Ids mostly come in increasing order, so the rank is usually the last one and nothing has to move
+  size_t rank = rank_after(list, event_id);
+  memmove(&list->ranks[rank + 1], &list->ranks[rank], (list->count - rank) * sizeof(struct EventSlot));
+  list->ranks[rank].id = event_id;
+  list->ranks[rank].position = (unsigned int)position + 1;
+
+  list->count++;
+  return event;
+}
+
+/// Removes an event from the index, moving back the entries probed after it so that no lookup misses them.
+/// @return Position of the event.
+static size_t unindex_event(struct EventList* list, unsigned int event_id) {
+  size_t mask = list->num_slots - 1;
+  size_t hole = slot_of(list, event_id);
+  while (list->slots[hole].id != event_id) hole = (hole + 1) & mask;
+  size_t position = list->slots[hole].position - 1;
+
+  for (size_t slot = (hole + 1) & mask; list->slots[slot].position != 0; slot = (slot + 1) & mask) {
+    // An entry can fill the hole unless its first slot lies between the hole and where it is now
+    size_t home = slot_of(list, list->slots[slot].id);
+    if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+      list->slots[hole] = list->slots[slot];
+      hole = slot;
+    }
+  }
+
+  list->slots[hole].position = 0;
+  return position;
+}
+
+void remove_from_list(struct EventList* list, struct Event* event) {
+  size_t position = unindex_event(list, event->id);
+
+  size_t rank = rank_after(list, event->id) - 1;
+  memmove(&list->ranks[rank], &list->ranks[rank + 1], (list->count - rank - 1) * sizeof(struct EventSlot));
+
+  list->free_positions[list->num_free++] = (unsigned int)position;
+  event->deleted = 1;
+  list->count--;
 }
 
 void free_list(struct EventList* list) {
   if (!list) return;
 
-  struct ListNode* current = list->head;
-  while (current) {
-    struct ListNode* temp = current;
-    current = current->next;
-
-    free_event(temp->event);
-    free(temp);
+  for (size_t i = 0; i < list->used; i++) {
+    struct Event* event = event_at(list, i);
+    pthread_mutex_destroy(&event->mutex);
+    free(event->data);
+    free(event->row_summaries);
   }
 
+  for (size_t c = 0; c < list->num_chunks; c++) free(list->chunks[c]);
+  free(list->chunks);
+  free(list->slots);
+  free(list->ranks);
+  free(list->free_positions);
+  pthread_rwlock_destroy(&list->rwl);
   free(list);
 }
 
-struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to) {
-  if (!list || !from || !to) return NULL;
-  struct ListNode* current = from;
+struct Event* get_event(struct EventList* list, unsigned int event_id) {
+  if (!list || list->num_slots == 0) return NULL;
 
-  while (1) {
-    if (current->event->id == event_id) {
-      return current->event;
-    }
+  for (size_t slot = slot_of(list, event_id);; slot = (slot + 1) & (list->num_slots - 1)) {
+    const struct EventSlot* entry = &list->slots[slot];
+    if (entry->position == 0) return NULL;
+    if (entry->id == event_id) return event_at(list, entry->position - 1);
+  }
+}
 
-    if (current == to) {
-      return NULL;
+size_t rank_after(const struct EventList* list, unsigned int event_id) {
+  size_t low = 0, high = list->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (list->ranks[middle].id <= event_id) {
+      low = middle + 1;
+    } else {
+      high = middle;
     }
-
-    current = current->next;
   }
+  return low;
+}
+
+struct Event* event_ranked(struct EventList* list, size_t rank) {
+  return event_at(list, list->ranks[rank].position - 1);
+}
+
+struct Event* event_at(struct EventList* list, size_t position) {
+  return &list->chunks[position / EVENT_SLAB_CHUNK][position % EVENT_SLAB_CHUNK];
 }
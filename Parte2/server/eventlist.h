@@ -2,52 +2,108 @@
 #define SERVER_EVENT_LIST_H
 
 #include <pthread.h>
+#include <stdalign.h>
 #include <stddef.h>
 
-struct Event {
-  unsigned int id;            /// Event id
-  unsigned int reservations;  /// Number of reservations for the event.
+#include "common/constants.h"
+
+/// Free space left in a row of an event.
+struct RowSummary {
+  size_t free_seats;     /// Seats of the row not reserved yet.
+  size_t longest_free;   /// Length of the longest run of free seats.
+  size_t longest_start;  /// Column of the first seat of that run, starting at 0.
+};
 
-  size_t cols;  /// Number of columns.
-  size_t rows;  /// Number of rows.
+/// An event, in a slot of the slab.
+/// @note Slots are never freed while the list is alive: a deleted event leaves its slot, with its mutex still
+/// initialized, to be reused by a later event. id, rows, cols, data, row_summaries and deleted only change with the
+/// list write-locked and the mutex held, so a pointer obtained before a deletion has to be checked once either is taken.
+struct Event {
+  // Read-mostly: set when the event is created, then only read by lookups and operations
+  unsigned int id;  /// Event id
+  size_t cols;      /// Number of columns.
+  size_t rows;      /// Number of rows.
+  unsigned int* data;  /// Array of size rows * cols with the reservations for each seat.
+  struct RowSummary* row_summaries;  /// Array of size rows, kept up to date with data under the mutex.
 
-  unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
-  pthread_mutex_t mutex;  // Mutex to protect the event
+  // Written by every reservation, so kept off the line that lookups read
+  alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;  // Mutex to protect the event
+  unsigned int reservations;                       /// Number of reservations for the event.
+  size_t free_seats;                               /// Number of seats not reserved yet.
+  int deleted;                                     /// Whether the slot is free, its event having been deleted.
 };
 
-struct ListNode {
-  struct Event* event;
-  struct ListNode* next;
+/// Slot of the index from event ids to positions in the slab, or of the list of events in id order.
+struct EventSlot {
+  unsigned int id;
+  unsigned int position;  /// Position of the event plus one, 0 if the slot is free.
 };
 
-// Linked list structure
+// Events stored in fixed chunks so that they never move, with a hash index on their ids. Slots are handed out in
+// creation order, except that the slots of deleted events are reused first
 struct EventList {
-  struct ListNode* head;  // Head of the list
-  struct ListNode* tail;  // Tail of the list
-  pthread_rwlock_t rwl;   // Mutex to protect the list
+  struct Event** chunks;         // Chunks of EVENT_SLAB_CHUNK events
+  size_t num_chunks;             // Chunks allocated
+  size_t used;                   // Slots handed out, deleted ones included
+  size_t count;                  // Number of events, not counting the deleted ones
+  unsigned int* free_positions;  // Positions of the slots of deleted events, with as much room as the chunks have
+  size_t num_free;
+  struct EventSlot* slots;       // Open addressing index, a power of two in size and at most half full
+  size_t num_slots;
+  unsigned int slot_bits;        // log2 of num_slots, the bits of the hash that pick a slot
+  struct EventSlot* ranks;       // Every event in id order, with as much room as the chunks have
+  pthread_rwlock_t rwl;          // Mutex to protect the list
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
-/// Appends a new node to the list.
+/// Appends a new event to the list.
+/// @note The list must be write-locked, and must not have an event with the same id. The slot of a deleted event is
+/// reused if there is one.
 /// @param list Event list to be modified.
-/// @param data Event to be stored in the new node.
-/// @return 0 if the node was appended successfully, 1 otherwise.
-int append_to_list(struct EventList* list, struct Event* data);
+/// @param event_id Id of the event.
+/// @param rows Number of rows of the event.
+/// @param cols Number of columns of the event.
+/// @param data Seats of the event, owned by the list once the event is appended.
+/// @return The new event, NULL on failure.
+struct Event* append_to_list(struct EventList* list, unsigned int event_id, size_t rows, size_t cols,
+                             unsigned int* data);
 
-/// Removes a node from the list.
+/// Removes an event from the list, leaving its slot to be reused.
+/// @note The list must be write-locked and the event mutex held. The caller takes the seats and row summaries out of
+/// the event first, leaving data and row_summaries NULL.
 /// @param list Event list to be modified.
-/// @return 0 if the node was removed successfully, 1 otherwise.
+/// @param event Event of the list to remove.
+void remove_from_list(struct EventList* list, struct Event* event);
+
+/// Frees the list and all its events.
+/// @param list Event list to be freed.
 void free_list(struct EventList* list);
 
 /// Retrieves an event in the list.
 /// @param list Event list to be searched
 /// @param event_id Event id.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to);
+struct Event* get_event(struct EventList* list, unsigned int event_id);
+
+/// Finds where the events with greater ids than a given one start in id order.
+/// @param list Event list, locked by the caller.
+/// @param event_id Id to search for, which does not have to belong to an event.
+/// @return Rank of the first event with a greater id, list->count if there is none.
+size_t rank_after(const struct EventList* list, unsigned int event_id);
+
+/// Retrieves an event by its rank in id order.
+/// @param list Event list, locked by the caller.
+/// @param rank Rank of the event, below list->count.
+/// @return Pointer to the event.
+struct Event* event_ranked(struct EventList* list, size_t rank);
+
+/// Retrieves an event by its position in the slab.
+/// @param list Event list, locked by the caller.
+/// @param position Position of the event, below list->used. The slot may hold a deleted event.
+/// @return Pointer to the event.
+struct Event* event_at(struct EventList* list, size_t position);
 
 #endif  // SERVER_EVENT_LIST_H
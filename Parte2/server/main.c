@@ -7,15 +7,20 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
 
+#include "async.h"
 #include "common/constants.h"
+#include "common/io.h"
+#include "common/protocol.h"
+#include "eventcache.h"
 #include "operations.h"
-#include <stdbool.h>
-
-#define MAX_SESSIONS 10  // Exemplo de limite de sessões
-
-void parseMsg(char buf[TAMMSG],char atribts[5][MAX_RESERVATION_SIZE]);
-void arrayXY(char *xys, size_t array[]);
+#include "placement.h"
+#include "requests.h"
+#include "stats.h"
+#include "trace.h"
 
 // Function to set up the named pipe and start the server
 int setup_named_pipe(const char *pipe_path) {
@@ -29,72 +34,303 @@ int setup_named_pipe(const char *pipe_path) {
     return 0;
 }
 
-bool active_sessions[MAX_SESSIONS] = {false};  // Rastrear sessões ativas
+/// Pedido de SETUP aceite pela thread principal, à espera de uma worker thread livre.
+struct PendingSession {
+  char req_pipe_path[PATH_MAX];
+  char resp_pipe_path[PATH_MAX];
+  enum SessionClass session_class;
+};
+
+/// Buffer produtor-consumidor entre a thread principal e as worker threads.
+static struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  struct PendingSession sessions[MAX_SESSION_COUNT];
+  size_t head;
+  size_t count;
+  uint64_t session_us;  // Média móvel da duração de uma sessão, para estimar quando uma worker thread fica livre
+} pending = {.mutex = PTHREAD_MUTEX_INITIALIZER,
+             .not_empty = PTHREAD_COND_INITIALIZER,
+             .not_full = PTHREAD_COND_INITIALIZER};
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
 
-// Função modificada para gerar session_id
-int generate_session_id() {
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (!active_sessions[i]) {
-            active_sessions[i] = true;  // Marca a sessão como ativa
-            return i;
-        }
+/// Serves the requests of a session until the client quits or goes away.
+/// @param session_id Id of the session.
+/// @param req_fd File descriptor of the request pipe.
+/// @param resp_fd File descriptor of the response pipe.
+static void serve_session(int session_id, int req_fd, int resp_fd) {
+  while (1) {
+    char msg[TAMMSG];
+    if (receive_message(req_fd, msg)) {
+      return;  // The client closed its request pipe without sending QUIT
     }
-    return -1;  // Retorna -1 se todas as sessões estiverem ativas
-}
 
-// Função para liberar session_id
-void release_session_id(int session_id) {
-    if (session_id >= 0 && session_id < MAX_SESSIONS) {
-        active_sessions[session_id] = false;  // Marca a sessão como inativa
+    uint64_t start = stats_begin();
+    trace_record(session_id, msg);
+
+    struct Buffer reply;
+    struct ReplyStream stream;
+    buffer_init(&reply);
+    stream_init(&stream);
+    enum StatsOp stats_op;
+    int failed = dispatch_request(msg, &reply, &stream, &stats_op) || write_all(resp_fd, reply.data, reply.len);
+    // Os chunks de um LIST ou SHOW são enviados um a um, reutilizando o buffer
+    while (!failed && stream.pending) {
+      reply.len = 0;
+      failed = stream_next(&stream, &reply) || write_all(resp_fd, reply.data, reply.len);
     }
+    stream_free(&stream);
+    buffer_free(&reply);
+    stats_end(stats_op, start);
+
+    if (failed || stats_op == STATS_OP_QUIT) {
+      return;
+    }
+  }
 }
 
+/// Worker thread: serves one session at a time, taken from the pending buffer.
+/// @param arg Index of the worker, used as the id of the sessions it serves.
+static void* session_worker(void* arg) {
+  int session_id = (int)(size_t)arg;
 
-// ---------------------- EX2 ----------------------------
-// Define the global flag and the signal handler
-volatile sig_atomic_t sigusr1_flag = 0;
+  while (1) {
+    pthread_mutex_lock(&pending.mutex);
+    while (pending.count == 0) {
+      pthread_cond_wait(&pending.not_empty, &pending.mutex);
+    }
+    struct PendingSession session = pending.sessions[pending.head];
+    pending.head = (pending.head + 1) % MAX_SESSION_COUNT;
+    pending.count--;
+    pthread_cond_signal(&pending.not_full);
+    pthread_mutex_unlock(&pending.mutex);
+
+    int req_fd, resp_fd;
+    if (connect_session(session_id, session.req_pipe_path, session.resp_pipe_path, &req_fd, &resp_fd, 0) != 0) {
+      continue;
+    }
+
+    uint64_t started = now_us();
+    trace_setup(session_id, session.req_pipe_path, session.resp_pipe_path);
+    store_session_details(session_id, session.req_pipe_path, session.resp_pipe_path);
+    serve_session(session_id, req_fd, resp_fd);
+    free_Session(session_id);
+    trace_flush();
 
-void printSeatStates(struct Event *event) {
-  // Iterate through the seats of the event and print their states
-  for (int i = 0; i < event->numSeats; ++i) {
-    printf("Seat %d: %s\n", i, (event->seats[i].isReserved ? "Reserved" : "Available"));
+    uint64_t elapsed = now_us() - started;
+    pthread_mutex_lock(&pending.mutex);
+    pending.session_us = pending.session_us == 0 ? elapsed : (pending.session_us * 7 + elapsed) / 8;
+    pthread_mutex_unlock(&pending.mutex);
+
+    close(req_fd);
+    close(resp_fd);
   }
+
+  return NULL;
 }
 
-void sigusr1_handler(int signum) {
-    sigusr1_flag = 1;
+/// Accepts SETUP requests and hands them to the worker threads.
+/// @param server_fd File descriptor of the server pipe.
+/// @return 1 if reading the server pipe fails.
+static int serve_sync(int server_fd) {
+  for (size_t w = 0; w < MAX_SESSION_COUNT; w++) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, session_worker, (void*)w) != 0) {
+      fprintf(stderr, "Failed to create worker thread\n");
+      return 1;
+    }
+    pthread_detach(tid);
+  }
+
+  while (1) {
+    char buf[TAMMSG];
+    if (receive_message(server_fd, buf)) {
+      perror("read");
+      return 1;
+    }
+
+    uint64_t setup_start = stats_begin();
+    struct PendingSession session;
+    if (parse_setup(buf, session.req_pipe_path, session.resp_pipe_path, &session.session_class) != 0) {
+      fprintf(stderr, "Invalid setup request\n");
+      stats_end(STATS_OP_COUNT, setup_start);
+      continue;
+    }
+
+    // Se todas as worker threads estiverem ocupadas, o pedido espera no buffer. Com o buffer cheio, os clientes
+    // normais são recusados com BUSY em vez de ficarem bloqueados no pipe do servidor; os prioritários esperam
+    pthread_mutex_lock(&pending.mutex);
+    if (pending.count == MAX_SESSION_COUNT && session.session_class == SESSION_CLASS_NORMAL) {
+      // Cada worker thread termina a sua sessão e as que estão no buffer antes de haver lugar para mais uma
+      uint64_t wait_ms = pending.session_us * (pending.count + MAX_SESSION_COUNT) / MAX_SESSION_COUNT / 1000;
+      pthread_mutex_unlock(&pending.mutex);
+
+      reject_session(session.resp_pipe_path, wait_ms < BUSY_RETRY_MIN_MS ? BUSY_RETRY_MIN_MS
+                                             : wait_ms < INT_MAX         ? (int)wait_ms
+                                                                         : INT_MAX);
+      stats_end(STATS_OP_BUSY, setup_start);
+      continue;
+    }
+    while (pending.count == MAX_SESSION_COUNT) {
+      pthread_cond_wait(&pending.not_full, &pending.mutex);
+    }
+    if (session.session_class == SESSION_CLASS_PRIORITY) {
+      // Sessões prioritárias passam à frente: são as próximas a ter uma worker thread
+      pending.head = (pending.head + MAX_SESSION_COUNT - 1) % MAX_SESSION_COUNT;
+      pending.sessions[pending.head] = session;
+    } else {
+      pending.sessions[(pending.head + pending.count) % MAX_SESSION_COUNT] = session;
+    }
+    pending.count++;
+    pthread_cond_signal(&pending.not_empty);
+    pthread_mutex_unlock(&pending.mutex);
+
+    stats_end(STATS_OP_SETUP, setup_start);
+  }
 }
 
-void showEvents() {
-  // Assuming you have a function to get the first event in your list
-  struct Event *event = getFirstEvent();
-  while (event != NULL) {
-    printf("Event ID: %d, Name: %s\n", event->id, event->name);
-    // Assuming you have a function to print the state of seats for an event
-    printSeatStates(event);
-    event = event->next;  // Move to the next event in the list
+
+// ---------------------- EX2 ----------------------------
+/// Writes a diagnostics snapshot of the server to DIAGNOSTICS_FILE.
+/// @note The snapshot is written to a temporary file and renamed, so readers never see a partial dump.
+/// @return 0 if the snapshot was written successfully, 1 otherwise.
+static int write_diagnostics(void) {
+  char tmp_path[sizeof(DIAGNOSTICS_FILE) + 4];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", DIAGNOSTICS_FILE);
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror("open - diagnostics file");
+    return 1;
+  }
+
+  int ret = print_str(fd, "== Sessions ==\n") || ems_dump_sessions(fd) || print_str(fd, "\n== Requests ==\n") ||
+            stats_print(fd) || event_cache_print(fd) || print_str(fd, "\n== Events ==\n") || ems_dump_events(fd);
+
+  if (close(fd) != 0) ret = 1;
+
+  if (ret == 0 && rename(tmp_path, DIAGNOSTICS_FILE) != 0) {
+    perror("rename - diagnostics file");
+    ret = 1;
   }
+
+  return ret;
 }
 
+/// Dedicated diagnostics thread: waits for SIGUSR1 and dumps the server state.
+/// @note SIGUSR1 must be blocked in every thread, so that it is only delivered through sigwait.
+static void* diagnostics_thread(void* arg) {
+  sigset_t* set = (sigset_t*)arg;
+
+  while (1) {
+    int sig;
+    if (sigwait(set, &sig) != 0) {
+      continue;
+    }
+
+    if (write_diagnostics() != 0) {
+      fprintf(stderr, "Failed to write diagnostics\n");
+    }
+    // Makes the requests traced so far readable along with the snapshot
+    trace_flush();
+  }
+
+  return NULL;
+}
 
 int main(int argc, char* argv[]) {
-  if (argc < 2 || argc > 3) {
-    fprintf(stderr, "Usage: %s\n <pipe_path> [delay]\n", argv[0]);
+  unsigned long async_threads = 0;  // 0: one worker thread per session
+  const char* trace_path = NULL;
+  unsigned long shard_index = 0, shard_count = 1;  // -s <index>/<count>: one of several servers sharing the events
+  const char* placement = NULL;  // -N <cpus>:<cpus>...: CPU sets the async server places events and executors on
+
+  int opt;
+  while ((opt = getopt(argc, argv, "a:r:s:N:A:")) != -1) {
+    char* endptr;
+    switch (opt) {
+      case 'a':
+        async_threads = strtoul(optarg, &endptr, 10);
+        if (*endptr != '\0' || async_threads == 0 || async_threads > MAX_ASYNC_THREADS) {
+          fprintf(stderr, "Invalid number of async threads\n");
+          return 1;
+        }
+        break;
+      case 'r':
+        trace_path = optarg;
+        break;
+      case 's':
+        shard_index = strtoul(optarg, &endptr, 10);
+        if (*endptr == '/') shard_count = strtoul(endptr + 1, &endptr, 10);
+        if (*endptr != '\0' || shard_count == 0 || shard_count > MAX_SHARDS || shard_index >= shard_count) {
+          fprintf(stderr, "Invalid shard, expected <index>/<count>\n");
+          return 1;
+        }
+        break;
+      case 'N':
+        if (placement_configure(optarg) != 0) {
+          fprintf(stderr, "Invalid placement, expected CPU sets such as 0-3:4-7\n");
+          return 1;
+        }
+        placement = optarg;
+        break;
+      case 'A':
+        // Eventos apagados com DELETE ... ARCHIVE ficam guardados neste diretório
+        ems_set_archive_dir(optarg);
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [-a threads] [-r trace] [-s index/count] [-N cpus:cpus...] [-A archive_dir] <pipe_path>"
+                " [delay]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+
+  if (argc - optind < 1 || argc - optind > 2) {
+    fprintf(stderr,
+            "Usage: %s [-a threads] [-r trace] [-s index/count] [-N cpus:cpus...] [-A archive_dir] <pipe_path>"
+            " [delay]\n",
+            argv[0]);
+    return 1;
+  }
+  const char* pipe_path = argv[optind];
+
+  if (placement != NULL && async_threads < placement_nodes()) {
+    fprintf(stderr, "Placement nodes need the async server (-a), with an executor thread per node\n");
     return 1;
   }
 
+  // A client that goes away must not kill the server when its response pipe is written
+  signal(SIGPIPE, SIG_IGN);
+
   // ---------------------------- EX2 -------------------------------------
-  // Registering the SIGUSR1 signal handler before creating any threads
-  struct sigaction sa;
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_handler = sigusr1_handler;
-  sigaction(SIGUSR1, &sa, NULL);
+  // Blocking SIGUSR1 before creating any threads, so that only the diagnostics thread receives it
+  static sigset_t diag_set;
+  sigemptyset(&diag_set);
+  sigaddset(&diag_set, SIGUSR1);
+  if (pthread_sigmask(SIG_BLOCK, &diag_set, NULL) != 0) {
+    fprintf(stderr, "Failed to block SIGUSR1\n");
+    return 1;
+  }
+
+  pthread_t diag_tid;
+  if (pthread_create(&diag_tid, NULL, diagnostics_thread, &diag_set) != 0) {
+    fprintf(stderr, "Failed to create diagnostics thread\n");
+    return 1;
+  }
+  pthread_detach(diag_tid);
   // ----------------------------------------------------------------------
 
   char* endptr;
   unsigned int state_access_delay_us = STATE_ACCESS_DELAY_US;
-  if (argc == 3) {
-    unsigned long int delay = strtoul(argv[2], &endptr, 10);
+  if (argc - optind == 2) {
+    unsigned long int delay = strtoul(argv[optind + 1], &endptr, 10);
 
     if (*endptr != '\0' || delay > UINT_MAX) {
       fprintf(stderr, "Invalid delay value or value too large\n");
@@ -109,168 +345,39 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  //TODO: Intialize server, create worker threads
-  // Set up the named pipe
-  if (setup_named_pipe(argv[1]) < 0) {
+  ems_set_shard((unsigned int)shard_index, (unsigned int)shard_count);
+
+  if (trace_path != NULL && trace_open(trace_path) != 0) {
+    fprintf(stderr, "Failed to open the trace\n");
+    return 1;
+  }
+
+  if (setup_named_pipe(pipe_path) < 0) {
     fprintf(stderr, "Failed to set up the named pipe\n");
     return 1;
   }
 
-  int server_fd = open(argv[1], O_RDONLY);
+  int server_fd = open(pipe_path, O_RDONLY);
   if (server_fd < 0) {
     perror("open");
     return 1;
   }
 
-  while (1) {
-    
-    // Se todas as sessões estiverem ativas, bloquear até que uma seja liberada
-    while (generate_session_id() == -1) {
-      // Pode adicionar um sleep aqui para evitar uso excessivo de CPU
-    }
-
-    char buf[TAMMSG];
-    
-    //char client_pipes[2][MAX_PATH_SIZE];  // Array to hold client's request and response pipe names
-
-    //session_message msg;
-    // Read from the server's named pipe
-    ssize_t num_read = read(server_fd, buf, TAMMSG);
-
-    if (num_read > 0) {
-      char atribts[5][MAX_RESERVATION_SIZE];
-      parseMsg(buf,atribts);
-
-
-      int session_id = generate_session_id();  // Generate new session ID
-
-      //strcpy(client_pipes[0],atribts[1]);strcpy(client_pipes[1],atribts[2]);
-      store_session_details(session_id, atribts[1], atribts[2]); // Store session details
-      // Open the client's response pipe and send the session ID
-      
-      int client_response_fd = open(atribts[1], O_WRONLY);
-      
-      if (client_response_fd < 0) {
-        perror("open - client response pipe");
-        continue;
-      }
-      // Send the session ID to the client
-      if (write(client_response_fd, &session_id, sizeof(session_id)) < 0) {
-        perror("write - session ID to client response pipe");
-      }
-      
-
-      
-      close(client_response_fd);  // Close the client's response pipe
-    }  else {
-      // An error occurred
-      perror("read");
-      break;
-    }
-    SessionNode *temp=SessionList();
-    while(temp!=NULL){
-      
-      int request_pipe=open(temp->request_pipe,O_RDONLY);
-      
-      int response_pipe=open(temp->response_pipe,O_WRONLY);
-      
-      char buffer[TAMMSG];
-      if(read(request_pipe,buffer,TAMMSG)<0)
-        perror("read");
-
-      char buffer1[TAMMSG];
-      strcpy(buffer1,buffer);
-      char atribts[5][MAX_RESERVATION_SIZE];
-      parseMsg(buffer,atribts);
-      
-      char ret_msg[TAMMSG];
-      printf("%c\n",buffer1[8]);
-      switch(buffer1[8]){
-        case '2':
-          
-          release_session_id(temp->session_id);
-          free_Session(temp->session_id);
-          break;
-        case '3':
-          ems_create((unsigned int) atoi(atribts[1]),(size_t) atoi(atribts[2]),(size_t) atoi(atribts[3]));
-          break;
-        case '4':
-          
-          size_t arrayX[MAX_RESERVATION_SIZE];
-          size_t arrayY[MAX_RESERVATION_SIZE];
-          arrayXY(atribts[3],arrayX);
-          arrayXY(atribts[4],arrayY);
-          ems_reserve((unsigned int)atoi(atribts[1]),(size_t)atoi(atribts[2]),arrayX,arrayY);
-          break;
-        case '5':
-          
-          size_t rows;
-          size_t cols;
-          int event_id=atoi(atribts[1]);
-          rows=getRows(event_id);
-          cols=getCols(event_id);
-          printf("%ld %ld\n",rows,cols);
-          sprintf(ret_msg,"%d|%ld|%ld|",1,rows,cols);
-          write(response_pipe,ret_msg,TAMMSG);
-          ems_show(response_pipe,(unsigned int)event_id);
-          break;
-        case '6':
-          size_t numEvents=getNumEvents();
-          sprintf(ret_msg,"%d|%ld|",1,numEvents);
-          write(response_pipe,ret_msg,TAMMSG);
-          ems_list_events(response_pipe);
-          break;
-      }
-
-      temp=temp->next;
-    }
+  // Keeping a writer open, so that reads block instead of returning EOF when no client is connected
+  int keepalive_fd = open(pipe_path, O_WRONLY);
+  if (keepalive_fd < 0) {
+    perror("open");
+    return 1;
   }
 
-  //TODO: Close Server
+  int ret = async_threads > 0 ? serve_async(server_fd, (unsigned int)async_threads) : serve_sync(server_fd);
+
   // Clean up and close the server's named pipe
+  close(keepalive_fd);
   close(server_fd);
-  unlink(argv[1]);
+  unlink(pipe_path);
 
+  trace_close();
   ems_terminate();
-  return 0;
-}
-
-void parseMsg(char buf[TAMMSG],char atribts[5][MAX_RESERVATION_SIZE]){
-    int i=0;
-    // Extract the first token
-    char * token = strtok(buf, "|");
-    strcpy(atribts[i],token);
-    i++;
-  // loop through the string to extract all other tokens
-    while( token != NULL ) {
-         //printing each token
-        token = strtok(NULL, "|");
-        if(token != NULL)
-            strcpy(atribts[i],token);
-        i++;
-    }
+  return ret;
 }
-
-void arrayXY(char *xys, size_t array[]){
-
-  int i=0;
-  int t=0;
-  char container[MAX_RESERVATION_SIZE]="";
-  int len=(int)strlen(xys);
-  while(i<len){
-    if(xys[i]=='[' ||xys[i]==']' ||xys[i]==' '  ){
-      if(i!=0){
-        if(t<5){
-        array[t]=(size_t)atoi(container);
-        if(t<5)
-        t++;
-        strcpy(container,"\0");}
-      }
-    }
-    else
-      strcat(container,&xys[i]);
-    i++;
-  }
-  return;
-  
-}
\ No newline at end of file
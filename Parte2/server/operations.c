@@ -6,25 +6,83 @@
 #include <pthread.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "buffer.h"
 #include "common/io.h"
+#include "eventcache.h"
 #include "eventlist.h"
 #include "operations.h"
 
 static struct EventList* event_list = NULL;
 static unsigned int state_access_delay_us = 0;
+static unsigned int shard_index = 0;  // This server owns the events with event_id % shard_count == shard_index
+static unsigned int shard_count = 1;
+static bool access_delay_deferred = false;  // Whether the caller waits for the access delay instead of the operations
+static const char* archive_dir = NULL;      // Directory the deleted events are archived to, if any
 
 /// Gets the event with the given ID from the state.
-/// @note Will wait to simulate a real system accessing a costly memory resource.
+/// @note Will wait to simulate a real system accessing a costly memory resource, unless the wait was deferred to the
+/// caller with ems_defer_access_delay.
 /// @param event_id The ID of the event to get.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode* from, struct ListNode* to) {
-  struct timespec delay = {0, state_access_delay_us * 1000};
-  nanosleep(&delay, NULL);  // Should not be removed
+static struct Event* get_event_with_delay(unsigned int event_id) {
+  if (!access_delay_deferred) {
+    struct timespec delay = {state_access_delay_us / 1000000, (state_access_delay_us % 1000000) * 1000};
+    nanosleep(&delay, NULL);  // Should not be removed
+  }
+
+  return get_event(event_list, event_id);
+}
+
+/// Gets the event with the given ID, going to the state only if it is not cached.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* lookup_event(unsigned int event_id) {
+  struct Event* event = event_cache_get(event_id);
+  if (event != NULL) {
+    return event;
+  }
+
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return NULL;
+  }
+
+  event = get_event_with_delay(event_id);
+
+  // Cached before the lock is released, so that an event deleted in the meantime is never put back in the cache
+  if (event != NULL) {
+    event_cache_put(event);
+  }
+
+  pthread_rwlock_unlock(&event_list->rwl);
+  return event;
+}
+
+/// Gets the event with the given ID and locks its mutex.
+/// @note The event may have been deleted, and its slot reused, between the lookup and the lock; it is then looked up
+/// again, from the state.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the locked event if found, NULL otherwise.
+static struct Event* lock_event(unsigned int event_id) {
+  while (1) {
+    struct Event* event = lookup_event(event_id);
+    if (event == NULL) {
+      return NULL;
+    }
+
+    if (pthread_mutex_lock(&event->mutex) != 0) {
+      fprintf(stderr, "Error locking mutex\n");
+      return NULL;
+    }
 
-  return get_event(event_list, event_id, from, to);
+    if (!event->deleted && event->id == event_id) {
+      return event;
+    }
+
+    pthread_mutex_unlock(&event->mutex);
+  }
 }
 
 /// Gets the index of a seat.
@@ -58,8 +116,10 @@ int ems_terminate() {
     return 1;
   }
 
-  free_list(event_list);
+  event_cache_clear();
   pthread_rwlock_unlock(&event_list->rwl);
+  free_list(event_list);
+  event_list = NULL;
   return 0;
 }
 
@@ -69,171 +129,477 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  if (event_id % shard_count != shard_index) {
+    fprintf(stderr, "Event belongs to another shard\n");
     return 1;
   }
 
-  if (get_event_with_delay(event_id, event_list->head, event_list->tail) != NULL) {
-    fprintf(stderr, "Event already exists\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+  // The dimensions come from the client, so the seats and row summaries are checked before anything is sized by them
+  if ((num_rows != 0 && num_cols > SIZE_MAX / sizeof(unsigned int) / num_rows) ||
+      num_rows > SIZE_MAX / sizeof(struct RowSummary)) {
+    fprintf(stderr, "Event too large\n");
     return 1;
   }
 
-  struct Event* event = malloc(sizeof(struct Event));
+  // A cached event certainly exists, so the costly lookup is only needed on a miss
+  if (event_cache_get(event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
+    return 1;
+  }
 
-  if (event == NULL) {
-    fprintf(stderr, "Error allocating memory for event\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
     return 1;
   }
 
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  if (pthread_mutex_init(&event->mutex, NULL) != 0) {
+  if (get_event_with_delay(event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
     pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
     return 1;
   }
-  event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
 
-  if (event->data == NULL) {
+  unsigned int* data = calloc(num_rows * num_cols, sizeof(unsigned int));
+  if (data == NULL) {
     fprintf(stderr, "Error allocating memory for event data\n");
     pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
     return 1;
   }
 
-  if (append_to_list(event_list, event) != 0) {
+  struct Event* event = append_to_list(event_list, event_id, num_rows, num_cols, data);
+  if (event == NULL) {
     fprintf(stderr, "Error appending event to list\n");
     pthread_rwlock_unlock(&event_list->rwl);
-    free(event->data);
-    free(event);
+    free(data);
     return 1;
   }
 
+  event_cache_invalidate(event_id);
+  event_cache_put(event);
+
   pthread_rwlock_unlock(&event_list->rwl);
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+/// Writes the state of an event: a summary line, then its seats a row per line.
+/// @note The state is rendered in memory first, so that it takes a single write.
+/// @param out_fd File descriptor to write to.
+/// @param event_id Id of the event.
+/// @param rows Number of rows of the event.
+/// @param cols Number of columns of the event.
+/// @param reservations Number of reservations of the event.
+/// @param free_seats Number of seats not reserved.
+/// @param seats Copy of the seats of the event.
+/// @return 0 if the state was written successfully, 1 otherwise.
+static int write_event_state(int out_fd, unsigned int event_id, size_t rows, size_t cols, unsigned int reservations,
+                             size_t free_seats, const unsigned int* seats) {
+  size_t total = rows * cols;
+  size_t taken = total - free_seats;
+  double occupancy = total > 0 ? 100.0 * (double)taken / (double)total : 0.0;
+
+  char line[256];
+  snprintf(line, sizeof(line), "Event %u: %zux%zu, %u reservations, %zu/%zu seats taken (%.1f%%)\n", event_id, rows,
+           cols, reservations, taken, total, occupancy);
+
+  struct Buffer out;
+  buffer_init(&out);
+  size_t position = 0;
+  int ret = buffer_print_str(&out, line) || ems_print_seats(&out, seats, cols, &position, total, SIZE_MAX - out.len) ||
+            write_all(out_fd, out.data, out.len);
+
+  buffer_free(&out);
+  return ret;
+}
+
+void ems_set_archive_dir(const char* dir) { archive_dir = dir; }
+
+/// Opens a temporary file to archive an event to, renamed into place once it is complete.
+/// @note The temporary file has a unique name, so that concurrent deletes of the same event never share it.
+/// @param event_id Id of the event to archive.
+/// @param tmp_path Buffer to store the path of the temporary file in.
+/// @param path Buffer to store the final path of the archive in.
+/// @return File descriptor of the temporary file, or -1 if it could not be opened.
+static int open_archive(unsigned int event_id, char tmp_path[PATH_MAX], char path[PATH_MAX]) {
+  if (archive_dir == NULL) {
+    fprintf(stderr, "No archive directory was given to the server\n");
+    return -1;
+  }
+
+  snprintf(path, PATH_MAX, "%s/event-%u.txt", archive_dir, event_id);
+  snprintf(tmp_path, PATH_MAX, "%s.XXXXXX", path);
+
+  int fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    perror("Error opening archive");
+  }
+  return fd;
+}
+
+int ems_delete(unsigned int event_id, int archive) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+  // Opened first, so that an event is never deleted when its archive cannot be written
+  char tmp_path[PATH_MAX], path[PATH_MAX];
+  int archive_fd = -1;
+  if (archive && (archive_fd = open_archive(event_id, tmp_path, path)) < 0) {
+    return 1;
+  }
+
+  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
     fprintf(stderr, "Error locking list rwl\n");
+    if (archive_fd >= 0) {
+      close(archive_fd);
+      unlink(tmp_path);
+    }
+    return 1;
+  }
+
+  struct Event* event = get_event_with_delay(event_id);
+  if (event == NULL) {
+    pthread_rwlock_unlock(&event_list->rwl);
+    fprintf(stderr, "Event not found\n");
+    if (archive_fd >= 0) {
+      close(archive_fd);
+      unlink(tmp_path);
+    }
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  // Holding the mutex waits out the operations already on the event; the ones still to come see it deleted
+  pthread_mutex_lock(&event->mutex);
+
+  size_t rows = event->rows;
+  size_t cols = event->cols;
+  unsigned int reservations = event->reservations;
+  size_t free_seats = event->free_seats;
+  unsigned int* seats = event->data;
+  struct RowSummary* row_summaries = event->row_summaries;
+  event->data = NULL;
+  event->row_summaries = NULL;
+
+  remove_from_list(event_list, event);
+  event_cache_invalidate(event_id);
 
+  pthread_mutex_unlock(&event->mutex);
   pthread_rwlock_unlock(&event_list->rwl);
 
+  // No one can reach the seats anymore, so they are archived and freed without any lock
+  free(row_summaries);
+
+  int ret = 0;
+  if (archive_fd >= 0) {
+    ret = write_event_state(archive_fd, event_id, rows, cols, reservations, free_seats, seats);
+    ret = close(archive_fd) != 0 || ret;
+    if (ret == 0 && rename(tmp_path, path) != 0) {
+      ret = 1;
+    }
+    if (ret != 0) {
+      fprintf(stderr, "Error writing archive of event %u\n", event_id);
+      unlink(tmp_path);
+    }
+  }
+
+  free(seats);
+  return ret;
+}
+
+/// Finds the longest run of free seats of a row.
+/// @note Must be called with the event mutex held.
+/// @param event Event of the row.
+/// @param row Row to scan, starting at 1.
+static void scan_row(struct Event* event, size_t row) {
+  struct RowSummary* summary = &event->row_summaries[row - 1];
+  const unsigned int* seats = &event->data[seat_index(event, row, 1)];
+  summary->longest_free = 0;
+  summary->longest_start = 0;
+
+  size_t run = 0;
+  for (size_t col = 0; col < event->cols; col++) {
+    run = seats[col] == 0 ? run + 1 : 0;
+    if (run > summary->longest_free) {
+      summary->longest_free = run;
+      summary->longest_start = col + 1 - run;
+    }
+  }
+}
+
+/// Updates the longest run of free seats of a row after seats of it were taken.
+/// @note Must be called with the event mutex held. The row is only scanned again if the seats overlap its longest run,
+/// since the runs that do not lose a seat stay as they were.
+/// @param event Event of the row.
+/// @param row Row of the seats, starting at 1.
+/// @param first_col First column of the seats taken, starting at 1.
+/// @param last_col Last column of the seats taken.
+static void update_longest_free(struct Event* event, size_t row, size_t first_col, size_t last_col) {
+  const struct RowSummary* summary = &event->row_summaries[row - 1];
+  if (first_col <= summary->longest_start + summary->longest_free && last_col > summary->longest_start) {
+    scan_row(event, row);
+  }
+}
+
+/// Creates a reservation for seats of an event.
+/// @note Must be called with the event mutex held.
+/// @param event Event to reserve the seats of.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats(struct Event* event, size_t num_seats, const size_t* xs, const size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Seat out of bounds\n");
+      return 1;
+    }
+  }
+
+  // Each seat is checked directly, so a batch of RESERVE_MULTI costs its seats rather than the size of the event
+  for (size_t i = 0; i < num_seats; i++) {
+    if (event->data[seat_index(event, xs[i], ys[i])] != 0) {
+      fprintf(stderr, "Seat already reserved\n");
+      return 1;
+    }
+  }
+
+  unsigned int reservation_id = ++event->reservations;
+
+  // A seat named twice is only taken once
+  for (size_t i = 0; i < num_seats; i++) {
+    unsigned int* seat = &event->data[seat_index(event, xs[i], ys[i])];
+    event->free_seats -= *seat == 0;
+    event->row_summaries[xs[i] - 1].free_seats -= *seat == 0;
+    *seat = reservation_id;
+  }
+
+  // Once a row has been scanned its longest run has none of the new seats, so each row is scanned at most once
+  for (size_t i = 0; i < num_seats; i++) {
+    update_longest_free(event, xs[i], ys[i], ys[i]);
+  }
+
+  return 0;
+}
+
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  struct Event* event = lock_event(event_id);
+
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
+  int ret = reserve_seats(event, num_seats, xs, ys);
+
+  pthread_mutex_unlock(&event->mutex);
+  return ret;
+}
+
+/// Checks whether every seat of a row segment is free.
+/// @note Scans the whole segment without branching on each seat, so that it can be vectorized.
+/// @param seats First seat of the segment.
+/// @param count Number of seats of the segment.
+/// @return 1 if no seat is reserved, 0 otherwise.
+static int seats_free(const unsigned int* seats, size_t count) {
+  unsigned int taken = 0;
+  for (size_t i = 0; i < count; i++) taken |= seats[i];
+  return taken == 0;
+}
+
+/// Reserves every seat of a row segment.
+/// @param seats First seat of the segment.
+/// @param count Number of seats of the segment.
+/// @param reservation_id Id of the reservation.
+/// @return Number of seats that were free, fewer than count where ranges of the same reservation overlap.
+static size_t fill_seats(unsigned int* seats, size_t count, unsigned int reservation_id) {
+  size_t taken = 0;
+  for (size_t i = 0; i < count; i++) {
+    taken += seats[i] == 0;
+    seats[i] = reservation_id;
+  }
+  return taken;
+}
+
+int ems_reserve_ranges(unsigned int event_id, size_t num_ranges, const struct SeatRange* ranges) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  for (size_t i = 0; i < num_seats; i++) {
-    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+  struct Event* event = lock_event(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  for (size_t r = 0; r < num_ranges; r++) {
+    const struct SeatRange* range = &ranges[r];
+    if (range->first_row == 0 || range->first_row > range->last_row || range->last_row > event->rows ||
+        range->first_col == 0 || range->first_col > range->last_col || range->last_col > event->cols) {
       fprintf(stderr, "Seat out of bounds\n");
       pthread_mutex_unlock(&event->mutex);
       return 1;
     }
   }
 
-  for (size_t i = 0; i < event->rows * event->cols; i++) {
-    for (size_t j = 0; j < num_seats; j++) {
-      if (seat_index(event, xs[j], ys[j]) != i) {
-        continue;
-      }
-
-      if (event->data[i] != 0) {
+  // Every range is checked before any seat is taken, so a conflict leaves the event untouched
+  for (size_t r = 0; r < num_ranges; r++) {
+    const struct SeatRange* range = &ranges[r];
+    size_t width = range->last_col - range->first_col + 1;
+    for (size_t row = range->first_row; row <= range->last_row; row++) {
+      if (!seats_free(&event->data[seat_index(event, row, range->first_col)], width)) {
         fprintf(stderr, "Seat already reserved\n");
         pthread_mutex_unlock(&event->mutex);
         return 1;
       }
-
-      break;
     }
   }
 
   unsigned int reservation_id = ++event->reservations;
 
-  for (size_t i = 0; i < num_seats; i++) {
-    event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
+  for (size_t r = 0; r < num_ranges; r++) {
+    const struct SeatRange* range = &ranges[r];
+    size_t width = range->last_col - range->first_col + 1;
+    for (size_t row = range->first_row; row <= range->last_row; row++) {
+      size_t taken = fill_seats(&event->data[seat_index(event, row, range->first_col)], width, reservation_id);
+      event->free_seats -= taken;
+      event->row_summaries[row - 1].free_seats -= taken;
+      update_longest_free(event, row, range->first_col, range->last_col);
+    }
   }
 
   pthread_mutex_unlock(&event->mutex);
   return 0;
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
+int ems_reserve_multi(unsigned int event_id, size_t num_groups, const size_t* sizes, const size_t* xs,
+                      const size_t* ys, int* results) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  struct Event* event = lock_event(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  // Each group is a reservation of its own: one that fails does not undo the others
+  size_t first = 0;
+  for (size_t g = 0; g < num_groups; g++) {
+    results[g] = reserve_seats(event, sizes[g], xs + first, ys + first);
+    first += sizes[g];
+  }
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+int ems_show(unsigned int event_id, size_t* rows, size_t* cols, unsigned int** seats) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  // Locked before its size is read, since a slot reused after a deletion may hold an event of another size
+  struct Event* event = lock_event(event_id);
 
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
+  *rows = event->rows;
+  *cols = event->cols;
+  *seats = NULL;
+  if (event->rows * event->cols == 0) {
+    pthread_mutex_unlock(&event->mutex);
+    return 0;
+  }
+
+  *seats = malloc(event->rows * event->cols * sizeof(unsigned int));
+  if (*seats == NULL) {
+    pthread_mutex_unlock(&event->mutex);
+    fprintf(stderr, "Error allocating memory for event output\n");
     return 1;
   }
 
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      char buffer[16];
-      sprintf(buffer, "%u", event->data[seat_index(event, i, j)]);
+  memcpy(*seats, event->data, event->rows * event->cols * sizeof(unsigned int));
 
-      if (print_str(out_fd, buffer)) {
-        perror("Error writing to file descriptor");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
 
-      if (j < event->cols) {
-        if (print_str(out_fd, " ")) {
-          perror("Error writing to file descriptor");
-          pthread_mutex_unlock(&event->mutex);
-          return 1;
-        }
-      }
-    }
+int ems_stats(struct Buffer* out, unsigned int event_id) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
 
-    if (print_str(out_fd, "\n")) {
-      perror("Error writing to file descriptor");
-      pthread_mutex_unlock(&event->mutex);
+  struct Event* event = lock_event(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  size_t num_rows = event->rows, num_cols = event->cols;
+  struct RowSummary* rows = calloc(num_rows, sizeof(struct RowSummary));
+  if (num_rows > 0 && rows == NULL) {
+    pthread_mutex_unlock(&event->mutex);
+    fprintf(stderr, "Error allocating memory for event statistics\n");
+    return 1;
+  }
+
+  unsigned int reservations = event->reservations;
+  size_t free_seats = event->free_seats;
+  if (num_rows > 0) {
+    memcpy(rows, event->row_summaries, num_rows * sizeof(struct RowSummary));
+  }
+
+  pthread_mutex_unlock(&event->mutex);
+
+  char line[160];
+  snprintf(line, sizeof(line), "Event %u: %zux%zu, %u reservations, %zu/%zu seats free\n", event_id, num_rows,
+           num_cols, reservations, free_seats, num_rows * num_cols);
+  int ret = buffer_print_str(out, line);
+
+  for (size_t row = 0; ret == 0 && row < num_rows; row++) {
+    snprintf(line, sizeof(line), "Row %zu: %zu free, longest run %zu\n", row + 1, rows[row].free_seats,
+             rows[row].longest_free);
+    ret = buffer_print_str(out, line);
+  }
+
+  if (ret != 0) {
+    fprintf(stderr, "Error allocating memory for event statistics\n");
+  }
+  free(rows);
+  return ret;
+}
+
+int ems_print_seats(struct Buffer* out, const unsigned int* seats, size_t cols, size_t* position, size_t num_seats,
+                    size_t max_bytes) {
+  size_t limit = out->len + max_bytes;
+
+  while (*position < num_seats && out->len < limit) {
+    size_t seat = (*position)++;
+    if (buffer_print_uint(out, seats[seat]) || buffer_print_str(out, (seat + 1) % cols == 0 ? "\n" : " ")) {
+      fprintf(stderr, "Error allocating memory for event output\n");
       return 1;
     }
   }
 
-  pthread_mutex_unlock(&event->mutex);
   return 0;
 }
 
-int ems_list_events(int out_fd) {
+int ems_list_events(size_t* count, size_t* end) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -244,46 +610,209 @@ int ems_list_events(int out_fd) {
     return 1;
   }
 
-  struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
+  *count = event_list->count;
+  *end = event_list->used;
 
-  if (current == NULL) {
-    char buff[] = "No events\n";
-    if (print_str(out_fd, buff)) {
-      perror("Error writing to file descriptor");
-      pthread_rwlock_unlock(&event_list->rwl);
+  pthread_rwlock_unlock(&event_list->rwl);
+  return 0;
+}
+
+int ems_print_events(struct Buffer* out, size_t* position, size_t end, size_t* unsent, size_t max_bytes) {
+  size_t limit = out->len + max_bytes;
+
+  // A slot freed by DELETE may be reused by CREATE after the snapshot, so the slots alone could exceed its count
+  if (*unsent == 0) {
+    *position = end;
+  }
+
+  while (*position < end && out->len < limit) {
+    // Printed with the lock held, since a slot may be deleted or reused once it is released
+    size_t first = *position - *position % EVENT_SLAB_CHUNK;
+    if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+      fprintf(stderr, "Error locking list rwl\n");
       return 1;
     }
+    const struct Event* chunk = event_at(event_list, first);
+
+    size_t chunk_end = first + EVENT_SLAB_CHUNK < end ? first + EVENT_SLAB_CHUNK : end;
+    for (; *position < chunk_end && out->len < limit; (*position)++) {
+      const struct Event* event = &chunk[*position - first];
+      if (event->deleted) continue;
+
+      if (buffer_print_str(out, "Event: ") || buffer_print_uint(out, event->id) || buffer_print_str(out, "\n")) {
+        pthread_rwlock_unlock(&event_list->rwl);
+        fprintf(stderr, "Error allocating memory for event list\n");
+        return 1;
+      }
+
+      if (--*unsent == 0) {
+        *position = end;
+        break;
+      }
+    }
 
     pthread_rwlock_unlock(&event_list->rwl);
+  }
+
+  return 0;
+}
+
+/// Checks whether an event passes the filters of a LIST query.
+/// @param query Query with the filters.
+/// @param seats Number of seats of the event.
+/// @param free_seats Number of seats of the event not reserved yet.
+/// @return 1 if the event passes every filter, 0 otherwise.
+static int event_matches(const struct ListQuery* query, size_t seats, size_t free_seats) {
+  if ((query->filters & LIST_FILTER_FREE) && free_seats == 0) return 0;
+  if ((query->filters & LIST_FILTER_OCCUPANCY) && (seats - free_seats) * 100 <= (size_t)query->occupancy * seats) {
     return 0;
   }
+  if ((query->filters & LIST_FILTER_SIZE) && (seats < query->min_seats || seats > query->max_seats)) return 0;
+  return 1;
+}
 
-  while (1) {
-    char buff[] = "Event: ";
-    if (print_str(out_fd, buff)) {
-      perror("Error writing to file descriptor");
-      pthread_rwlock_unlock(&event_list->rwl);
+int ems_query_events(struct Buffer* out, const struct ListQuery* query, size_t* listed) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  unsigned int after_id = query->after_id;
+  *listed = 0;
+
+  while (*listed < query->limit) {
+    if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+      fprintf(stderr, "Error locking list rwl\n");
       return 1;
     }
 
-    char id[16];
-    sprintf(id, "%u\n", (current->event)->id);
-    if (print_str(out_fd, id)) {
-      perror("Error writing to file descriptor");
-      pthread_rwlock_unlock(&event_list->rwl);
-      return 1;
+    // Ranks shift when an event is created, so each batch starts again from the last id seen
+    size_t rank = rank_after(event_list, after_id);
+    size_t end = rank + EVENT_SLAB_CHUNK < event_list->count ? rank + EVENT_SLAB_CHUNK : event_list->count;
+    for (; rank < end && *listed < query->limit; rank++) {
+      struct Event* event = event_ranked(event_list, rank);
+      after_id = event->id;
+
+      pthread_mutex_lock(&event->mutex);
+      size_t free_seats = event->free_seats;
+      pthread_mutex_unlock(&event->mutex);
+
+      size_t seats = event->rows * event->cols;
+      if (!event_matches(query, seats, free_seats)) continue;
+
+      char line[96];
+      snprintf(line, sizeof(line), "Event: %u (%zux%zu, %zu free)\n", event->id, event->rows, event->cols, free_seats);
+      if (buffer_print_str(out, line)) {
+        pthread_rwlock_unlock(&event_list->rwl);
+        fprintf(stderr, "Error allocating memory for event list\n");
+        return 1;
+      }
+      (*listed)++;
     }
 
-    if (current == to) {
+    int done = rank == event_list->count;
+    pthread_rwlock_unlock(&event_list->rwl);
+    if (done) break;
+  }
+
+  return 0;
+}
+
+void ems_set_shard(unsigned int index, unsigned int count) {
+  shard_index = index;
+  shard_count = count;
+}
+
+void ems_defer_access_delay(void) { access_delay_deferred = true; }
+
+unsigned int ems_access_delay(void) { return state_access_delay_us; }
+
+int ems_event_cached(unsigned int event_id) { return event_cache_contains(event_id); }
+
+size_t ems_event_seats(unsigned int event_id) {
+  if (event_list == NULL || pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    return 0;
+  }
+
+  struct Event* event = get_event(event_list, event_id);
+  size_t seats = event != NULL ? event->rows * event->cols : 0;
+
+  pthread_rwlock_unlock(&event_list->rwl);
+  return seats;
+}
+
+int ems_dump_events(int out_fd) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  // Events never move, so the slots in use stay valid once the lock is released; deleted ones are skipped
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  size_t count = event_list->count;
+  size_t used = event_list->used;
+
+  pthread_rwlock_unlock(&event_list->rwl);
+
+  if (count == 0) {
+    return print_str(out_fd, "No events\n");
+  }
+
+  unsigned int* seats = NULL;
+  size_t capacity = 0;
+  int ret = 0;
+
+  for (size_t e = 0; e < used && ret == 0; e++) {
+    // The chunk table may be reallocated by a concurrent ems_create, the chunks themselves are not
+    pthread_rwlock_rdlock(&event_list->rwl);
+    struct Event* event = event_at(event_list, e);
+    pthread_rwlock_unlock(&event_list->rwl);
+
+    // Copy one event at a time so that each mutex is only held for a memcpy
+    if (pthread_mutex_lock(&event->mutex) != 0) {
+      fprintf(stderr, "Error locking mutex\n");
+      ret = 1;
       break;
     }
 
-    current = current->next;
+    if (event->deleted) {
+      pthread_mutex_unlock(&event->mutex);
+      continue;
+    }
+
+    unsigned int event_id = event->id;
+    size_t rows = event->rows;
+    size_t cols = event->cols;
+    unsigned int reservations = event->reservations;
+    size_t free_seats = event->free_seats;
+
+    if (rows * cols > capacity) {
+      unsigned int* grown = realloc(seats, rows * cols * sizeof(unsigned int));
+      if (grown == NULL) {
+        pthread_mutex_unlock(&event->mutex);
+        fprintf(stderr, "Error allocating memory for snapshot\n");
+        ret = 1;
+        break;
+      }
+      seats = grown;
+      capacity = rows * cols;
+    }
+
+    if (rows * cols > 0) {
+      memcpy(seats, event->data, rows * cols * sizeof(unsigned int));
+    }
+
+    pthread_mutex_unlock(&event->mutex);
+
+    ret = write_event_state(out_fd, event_id, rows, cols, reservations, free_seats, seats);
   }
 
-  pthread_rwlock_unlock(&event_list->rwl);
-  return 0;
+  free(seats);
+  return ret;
 }
 
 // Mutex for thread-safe incrementing of the session ID
@@ -312,10 +841,6 @@ pthread_mutex_t sessions_mutex = PTHREAD_MUTEX_INITIALIZER;
  * This list would be used to manage sessions and facilitate communication between the server and its clients.
 */
 
-struct Event *getFirstEvent(){
-  return event_list->head;
-}
-
 void store_session_details(int session_id, const char* request_pipe, const char* response_pipe) {
   pthread_mutex_lock(&sessions_mutex);
     SessionNode* new_node = malloc(sizeof(SessionNode));
@@ -350,18 +875,40 @@ void free_sessions() {
     sessions_head = NULL;
     pthread_mutex_unlock(&sessions_mutex);
 }
-void free_Session(int id){
-  SessionNode* current = sessions_head;
-  while (current != NULL) {
-    current = current->next;
-    if(current->next!=NULL && current->next->session_id==id){
-      SessionNode* temp = current->next;
-      current->next=temp->next;
+void free_Session(int id) {
+  pthread_mutex_lock(&sessions_mutex);
+  SessionNode** link = &sessions_head;
+  while (*link != NULL) {
+    if ((*link)->session_id == id) {
+      SessionNode* temp = *link;
+      *link = temp->next;
       free(temp);
       break;
     }
-    
+    link = &(*link)->next;
+  }
+  pthread_mutex_unlock(&sessions_mutex);
+}
+
+int ems_dump_sessions(int out_fd) {
+  pthread_mutex_lock(&sessions_mutex);
+
+  int ret = 0;
+  size_t count = 0;
+  for (SessionNode* current = sessions_head; current != NULL && ret == 0; current = current->next) {
+    char line[2 * PATH_MAX + 64];
+    snprintf(line, sizeof(line), "Session %d: request %s, response %s\n", current->session_id, current->request_pipe,
+             current->response_pipe);
+    ret = print_str(out_fd, line);
+    count++;
   }
+
+  if (ret == 0 && count == 0) {
+    ret = print_str(out_fd, "No active sessions\n");
+  }
+
+  pthread_mutex_unlock(&sessions_mutex);
+  return ret;
 }
 
 SessionNode *SessionList(){
@@ -374,24 +921,6 @@ void destroy_mutexes() {
     pthread_mutex_destroy(&session_id_mutex);
     pthread_mutex_destroy(&sessions_mutex);
 }
-size_t getRows(int event_id){
-  struct Event* event= get_event(event_list,(unsigned int) event_id, event_list->head, event_list->tail);
-  return event->rows;
-}
-size_t getCols(int event_id){
-  struct Event* event= get_event(event_list,(unsigned int) event_id, event_list->head, event_list->tail);
-  return event->cols;
-}
-size_t getNumEvents(){
-  struct ListNode *temp;
-  size_t numEvents=0;
-  temp= event_list->head;
-  while(temp!=NULL){
-    temp=temp->next;
-    numEvents++;
-  }
-  return numEvents;
-}
 // ----------------------------------------------------------------------------------------------------------------------
 
 // Estrutura para representar uma mensagem
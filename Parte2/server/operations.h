@@ -1,8 +1,12 @@
 #ifndef SERVER_OPERATIONS_H
 #define SERVER_OPERATIONS_H
 
+#include <limits.h>
 #include <stddef.h>
 
+#include "buffer.h"
+#include "common/protocol.h"
+
 
 // Node structure for the session linked list
 typedef struct SessionNode {
@@ -27,6 +31,19 @@ int ems_terminate();
 /// @return 0 if the event was created successfully, 1 otherwise.
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 
+/// Sets the directory that deleted events are archived to.
+/// @param dir Path of the directory, which must outlive the EMS state; NULL disables archiving.
+void ems_set_archive_dir(const char* dir);
+
+/// Deletes an event, releasing its seats, and optionally archives its final state.
+/// @note The slot of the event is kept, and reused by a later ems_create, so that operations that found it before the
+/// delete can still lock its mutex and see it deleted. The archive is "<dir>/event-<id>.txt", written in the format of
+/// ems_dump_events through a temporary file, so that it only appears once it is complete.
+/// @param event_id Id of the event to delete.
+/// @param archive Whether to archive the event; the event is not deleted if its archive cannot be opened.
+/// @return 0 if the event was deleted (and archived) successfully, 1 otherwise.
+int ems_delete(unsigned int event_id, int archive);
+
 /// Creates a new reservation for the given event.
 /// @param event_id Id of the event to create a reservation for.
 /// @param num_seats Number of seats to reserve.
@@ -35,16 +52,115 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
 
-/// Prints the given event.
-/// @param out_fd File descriptor to print the event to.
-/// @param event_id Id of the event to print.
-/// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(int out_fd, unsigned int event_id);
-
-/// Prints all the events.
-/// @param out_fd File descriptor to print the events to.
+/// Creates a reservation for every seat in the given ranges.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_ranges Number of ranges.
+/// @param ranges Array of blocks of seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_ranges(unsigned int event_id, size_t num_ranges, const struct SeatRange *ranges);
+
+/// Creates several independent reservations for the given event, with a single lookup and lock of the event.
+/// @param event_id Id of the event to create the reservations for.
+/// @param num_groups Number of reservations.
+/// @param sizes Array with the number of seats of each reservation.
+/// @param xs Array of rows of the seats, the seats of each reservation after those of the previous one.
+/// @param ys Array of columns of the seats, in the same order as xs.
+/// @param results Array to store, for each reservation, 0 if it was created and 1 otherwise.
+/// @return 0 if the event was found and the reservations were attempted, 1 otherwise.
+int ems_reserve_multi(unsigned int event_id, size_t num_groups, const size_t *sizes, const size_t *xs,
+                      const size_t *ys, int *results);
+
+/// Takes a snapshot of the seats of an event, to be printed with ems_print_seats without holding its lock.
+/// @param event_id Id of the event.
+/// @param rows Pointer to store the number of rows of the event in.
+/// @param cols Pointer to store the number of columns of the event in.
+/// @param seats Pointer to store the copy of the seats in, to be released with free; NULL if the event has none.
+/// @return 0 if the snapshot was taken successfully, 1 otherwise.
+int ems_show(unsigned int event_id, size_t* rows, size_t* cols, unsigned int** seats);
+
+/// Prints the occupancy of an event from its counters, without looking at its seats.
+/// @note Prints "Event <id>: <rows>x<cols>, <n> reservations, <free>/<seats> seats free", then a line per row with its
+/// free seats and its longest run of free seats.
+/// @param out Buffer to print the statistics to.
+/// @param event_id Id of the event.
+/// @return 0 if the statistics were printed successfully, 1 otherwise.
+int ems_stats(struct Buffer* out, unsigned int event_id);
+
+/// Prints seats of a snapshot taken by ems_show, a row per line.
+/// @param out Buffer to print the seats to.
+/// @param seats Seats of the snapshot.
+/// @param cols Number of columns of the event.
+/// @param position Index of the next seat to print, advanced past the seats printed.
+/// @param num_seats Number of seats of the snapshot.
+/// @param max_bytes Number of bytes after which to stop, at the end of a seat.
+/// @return 0 if the seats were printed successfully, 1 otherwise.
+int ems_print_seats(struct Buffer* out, const unsigned int* seats, size_t cols, size_t* position, size_t num_seats,
+                    size_t max_bytes);
+
+/// Takes a snapshot of the events, to be printed with ems_print_events without holding the list lock.
+/// @note Events are never moved once created, so the snapshot is just how many slots of the slab are in use.
+/// @param count Pointer to store the number of events in.
+/// @param end Pointer to store the number of slots in use in, deleted events included.
+/// @return 0 if the snapshot was taken successfully, 1 otherwise.
+int ems_list_events(size_t* count, size_t* end);
+
+/// Prints events of a snapshot taken by ems_list_events, as "Event: <id>" lines in slab order.
+/// @note Only holds the list lock while it prints each EVENT_SLAB_CHUNK slots. Slab order is creation order until
+/// events are deleted, as the slots they leave are reused first. Deleted slots are skipped, and events created in
+/// them after the snapshot are printed in their place, up to the count of the snapshot.
+/// @param out Buffer to print the events to.
+/// @param position Index of the next slot to print, advanced past the slots printed.
+/// @param end Number of slots of the snapshot.
+/// @param unsent Pointer to the number of events left to print, decreased by the events printed.
+/// @param max_bytes Number of bytes after which to stop, at the end of a line.
 /// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events(int out_fd);
+int ems_print_events(struct Buffer* out, size_t* position, size_t end, size_t* unsent, size_t max_bytes);
+
+/// Prints a page of the events that pass the filters of a query, as "Event: <id> (<rows>x<cols>, <free> free)" lines
+/// in id order.
+/// @note Only holds the list lock for EVENT_SLAB_CHUNK events at a time, going on after the last id it saw.
+/// @param out Buffer to print the events to.
+/// @param query Page and filters of the query, with a limit between 1 and LIST_PAGE_MAX.
+/// @param listed Pointer to store the number of events printed in.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+int ems_query_events(struct Buffer* out, const struct ListQuery* query, size_t* listed);
+
+/// Makes this server one of several sharing the events, refusing to create the events of the others.
+/// @param index Index of this server, below count.
+/// @param count Number of servers; the server with index event_id % count owns each event.
+void ems_set_shard(unsigned int index, unsigned int count);
+
+/// Makes the operations skip the state access delay, leaving it to the caller.
+/// @note Used by the async server, which waits for the delay on a timer instead of putting a thread to sleep. The
+/// caller must wait ems_access_delay() before an operation whose event is not cached.
+void ems_defer_access_delay(void);
+
+/// Gets the state access delay.
+/// @return Delay in microseconds.
+unsigned int ems_access_delay(void);
+
+/// Checks whether an event can be looked up without paying the state access delay.
+/// @param event_id Id of the event to check.
+/// @return 1 if the event is cached, 0 otherwise.
+int ems_event_cached(unsigned int event_id);
+
+/// Gets the number of seats of an event, without paying the state access delay.
+/// @note Only reads the dimensions, which never change once the event is created, so that schedulers can estimate
+/// the cost of a request before running it.
+/// @param event_id Id of the event.
+/// @return Number of seats of the event, 0 if it does not exist.
+size_t ems_event_seats(unsigned int event_id);
+
+/// Writes a snapshot of every event, with its occupancy summary and seats.
+/// @note Each event is copied under its own mutex and written after releasing it, so no lock is held for long.
+/// @param out_fd File descriptor to write the snapshot to.
+/// @return 0 if the snapshot was written successfully, 1 otherwise.
+int ems_dump_events(int out_fd);
+
+/// Writes the list of active sessions.
+/// @param out_fd File descriptor to write the sessions to.
+/// @return 0 if the sessions were written successfully, 1 otherwise.
+int ems_dump_sessions(int out_fd);
 
 void store_session_details(int session_id, const char* request_pipe, const char* response_pipe);
 
@@ -56,13 +172,5 @@ void destroy_mutexes();
 
 SessionNode *SessionList();
 
-size_t getRows(int event_id);
-
-size_t getCols(int event_id);
-
-size_t getNumEvents();
-
-struct Event *getFirstEvent();
-
 
 #endif  // SERVER_OPERATIONS_H
@@ -0,0 +1,71 @@
+#define _GNU_SOURCE  // cpu_set_t and pthread_setaffinity_np
+
+#include "placement.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/constants.h"
+
+static cpu_set_t node_cpus[MAX_PLACEMENT_NODES];
+static unsigned int num_nodes = 0;  // 0 when the threads are not pinned
+
+/// Parses a list of CPUs and ranges such as "0-3,8".
+/// @param list List to parse, modified in place.
+/// @param cpus Set to store the CPUs in.
+/// @return 0 if the list is valid and not empty, 1 otherwise.
+static int parse_cpus(char* list, cpu_set_t* cpus) {
+  CPU_ZERO(cpus);
+
+  char* saveptr = NULL;
+  for (char* item = strtok_r(list, ",", &saveptr); item != NULL; item = strtok_r(NULL, ",", &saveptr)) {
+    char* endptr;
+    unsigned long first = strtoul(item, &endptr, 10), last = first;
+    if (endptr == item) return 1;
+    if (*endptr == '-') {
+      char* start = endptr + 1;
+      last = strtoul(start, &endptr, 10);
+      if (endptr == start) return 1;
+    }
+    if (*endptr != '\0' || first > last || last >= CPU_SETSIZE) return 1;
+
+    for (unsigned long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+  }
+
+  return CPU_COUNT(cpus) == 0;
+}
+
+int placement_configure(const char* spec) {
+  char copy[1024];
+  if (strlen(spec) >= sizeof(copy)) return 1;
+  strcpy(copy, spec);
+
+  unsigned int count = 0;
+  char* saveptr = NULL;
+  for (char* node = strtok_r(copy, ":", &saveptr); node != NULL; node = strtok_r(NULL, ":", &saveptr)) {
+    if (count == MAX_PLACEMENT_NODES || parse_cpus(node, &node_cpus[count])) return 1;
+    count++;
+  }
+
+  num_nodes = count;
+  return count == 0;
+}
+
+unsigned int placement_nodes(void) { return num_nodes > 0 ? num_nodes : 1; }
+
+unsigned int placement_event_node(unsigned int event_id) { return event_id % placement_nodes(); }
+
+int placement_pin(unsigned int node) {
+  if (num_nodes == 0) return 0;
+
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &node_cpus[node]);
+  if (err != 0) {
+    fprintf(stderr, "Failed to pin thread to node %u: %s\n", node, strerror(err));
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef SERVER_PLACEMENT_H
+#define SERVER_PLACEMENT_H
+
+/// Splits the machine into nodes, each a set of CPUs, for the async server to place events and executors on.
+/// @note Every event has a home node, and its requests are run by executors pinned to that node. That includes the
+/// CREATE, so the seats of the event are first touched, and therefore allocated by the kernel, on its home node. The
+/// CPU sets are those of the NUMA nodes (see lscpu), or any split of the CPUs to try the mode on a single node.
+/// @param spec CPU sets of the nodes separated by ':', each a list of CPUs and ranges such as "0-3,8".
+/// @return 0 if the nodes were configured successfully, 1 otherwise.
+int placement_configure(const char* spec);
+
+/// Gets the number of nodes.
+/// @return Number of nodes, 1 if no nodes were configured.
+unsigned int placement_nodes(void);
+
+/// Gets the home node of an event.
+/// @param event_id Id of the event.
+/// @return Index of the node.
+unsigned int placement_event_node(unsigned int event_id);
+
+/// Pins the calling thread to the CPUs of a node.
+/// @param node Index of the node.
+/// @return 0 if the thread was pinned (or no nodes were configured), 1 otherwise.
+int placement_pin(unsigned int node);
+
+#endif  // SERVER_PLACEMENT_H
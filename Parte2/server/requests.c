@@ -0,0 +1,506 @@
+#include "requests.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "operations.h"
+
+#define REQUEST_COST_SEATS 64  // Seats touched by a request that cost as much as the request itself
+#define REQUEST_COST_MAX 1024   // Cost of the largest requests, whose sizes are not validated yet
+
+int parse_setup(char msg[TAMMSG], char req_pipe_path[PATH_MAX], char resp_pipe_path[PATH_MAX],
+                enum SessionClass* session_class) {
+  char* fields[4];
+  size_t num_fields = split_message(msg, fields, 4);
+  if (num_fields < 3 || message_op_code(fields[0]) != OP_SETUP || strlen(fields[1]) >= PATH_MAX ||
+      strlen(fields[2]) >= PATH_MAX) {
+    return 1;
+  }
+
+  *session_class = SESSION_CLASS_NORMAL;
+  if (num_fields == 4) {
+    char* endptr;
+    unsigned long requested = strtoul(fields[3], &endptr, 10);
+    if (endptr == fields[3] || *endptr != '\0' || requested >= SESSION_CLASS_COUNT) {
+      return 1;
+    }
+    *session_class = (enum SessionClass)requested;
+  }
+
+  strcpy(req_pipe_path, fields[1]);
+  strcpy(resp_pipe_path, fields[2]);
+  return 0;
+}
+
+int connect_session(int session_id, const char* req_pipe_path, const char* resp_pipe_path, int* req_fd, int* resp_fd,
+                    int nonblocking) {
+  // The client opened its response pipe before sending SETUP; ENXIO means it went away since
+  *resp_fd = open(resp_pipe_path, O_WRONLY | O_NONBLOCK);
+  if (*resp_fd < 0) {
+    if (errno != ENXIO) perror("open - client response pipe");
+    return 1;
+  }
+
+  // The pipe is empty, so the id is written at once even without waiting
+  if (write_all(*resp_fd, &session_id, sizeof(session_id)) || (!nonblocking && fcntl(*resp_fd, F_SETFL, 0) == -1)) {
+    perror("write - session ID to client response pipe");
+    close(*resp_fd);
+    return 1;
+  }
+
+  // The client opens its request pipe once it has the id. Without waiting for it, the pipe is only readable once it
+  // has, so it has to be polled before it is read
+  *req_fd = open(req_pipe_path, nonblocking ? O_RDONLY | O_NONBLOCK : O_RDONLY);
+  if (*req_fd < 0) {
+    perror("open - client request pipe");
+    close(*resp_fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+void reject_session(const char* resp_pipe_path, int retry_after_ms) {
+  // The client opened its response pipe before sending SETUP, so there is nothing to wait for
+  int resp_fd = open(resp_pipe_path, O_WRONLY | O_NONBLOCK);
+  if (resp_fd < 0) {
+    // ENXIO: the client went away before it could be refused
+    if (errno != ENXIO) perror("open - client response pipe");
+    return;
+  }
+
+  int answer[2] = {SESSION_BUSY, retry_after_ms};
+  if (write_all(resp_fd, answer, sizeof(answer))) {
+    perror("write - busy session to client response pipe");
+  }
+  close(resp_fd);
+}
+
+/// Parses an unsigned integer field.
+/// @param field Field to parse.
+/// @param value Pointer to store the value in.
+/// @return 0 if the field is a valid unsigned integer, 1 otherwise.
+static int parse_size(const char* field, size_t* value) {
+  char* endptr;
+  unsigned long parsed = strtoul(field, &endptr, 10);
+  if (endptr == field || *endptr != '\0') {
+    return 1;
+  }
+
+  *value = (size_t)parsed;
+  return 0;
+}
+
+/// Parses a list of coordinates "[<c1> <c2> ...]".
+/// @param field Field to parse, modified in place.
+/// @param coords Array to store the coordinates in.
+/// @param count Number of coordinates expected.
+/// @return 0 if the list has exactly count coordinates, 1 otherwise.
+static int parse_coords(char* field, size_t coords[], size_t count) {
+  size_t len = strlen(field);
+  if (len < 2 || field[0] != '[' || field[len - 1] != ']') {
+    return 1;
+  }
+  field[len - 1] = '\0';
+
+  size_t found = 0;
+  char* saveptr = NULL;
+  for (char* token = strtok_r(field + 1, " ", &saveptr); token != NULL; token = strtok_r(NULL, " ", &saveptr)) {
+    if (found == count || parse_size(token, &coords[found])) {
+      return 1;
+    }
+    found++;
+  }
+
+  return found != count;
+}
+
+/// Parses a list of spans "[<a1>-<b1> <a2>-<b2> ...]", where "<a>" stands for "<a>-<a>".
+/// @param field Field to parse, modified in place.
+/// @param ranges Array to store the spans in, as rows or as columns.
+/// @param count Number of spans expected.
+/// @param rows Whether the spans are rows, otherwise they are columns.
+/// @return 0 if the list has exactly count spans, 1 otherwise.
+static int parse_spans(char* field, struct SeatRange ranges[], size_t count, int rows) {
+  size_t len = strlen(field);
+  if (len < 2 || field[0] != '[' || field[len - 1] != ']') {
+    return 1;
+  }
+  field[len - 1] = '\0';
+
+  size_t found = 0;
+  char* saveptr = NULL;
+  for (char* token = strtok_r(field + 1, " ", &saveptr); token != NULL; token = strtok_r(NULL, " ", &saveptr)) {
+    if (found == count) {
+      return 1;
+    }
+
+    size_t first, last;
+    char* dash = strchr(token, '-');
+    if (dash != NULL) *dash = '\0';
+    if (parse_size(token, &first) || parse_size(dash != NULL ? dash + 1 : token, &last)) {
+      return 1;
+    }
+
+    if (rows) {
+      ranges[found].first_row = first;
+      ranges[found].last_row = last;
+    } else {
+      ranges[found].first_col = first;
+      ranges[found].last_col = last;
+    }
+    found++;
+  }
+
+  return found != count;
+}
+
+/// Parses the fields of a LIST query.
+/// @param fields The six fields after the operation code.
+/// @param query Query to store the page and filters in.
+/// @return 0 if the query is valid, 1 otherwise.
+static int parse_list_query(char* fields[6], struct ListQuery* query) {
+  size_t after_id, filters, occupancy;
+  if (parse_size(fields[0], &after_id) || parse_size(fields[1], &query->limit) || parse_size(fields[2], &filters) ||
+      parse_size(fields[3], &occupancy) || parse_size(fields[4], &query->min_seats) ||
+      parse_size(fields[5], &query->max_seats) || after_id > UINT_MAX ||
+      filters > (LIST_FILTER_FREE | LIST_FILTER_OCCUPANCY | LIST_FILTER_SIZE) || occupancy > 100) {
+    return 1;
+  }
+
+  query->after_id = (unsigned int)after_id;
+  query->filters = (unsigned int)filters;
+  query->occupancy = (unsigned int)occupancy;
+  if (query->limit == 0 || query->limit > LIST_PAGE_MAX) {
+    query->limit = LIST_PAGE_MAX;
+  }
+  return 0;
+}
+
+int parse_request(char msg[TAMMSG], struct Request* request) {
+  char* fields[7];
+  size_t num_fields = split_message(msg, fields, 7);
+  if (num_fields == 0) {
+    return 1;
+  }
+
+  int op = message_op_code(fields[0]);
+  size_t event_id;
+
+  switch (op) {
+    case OP_QUIT:
+      request->op = (enum OpCode)op;
+      return num_fields != 1;
+
+    case OP_LIST:
+      request->op = (enum OpCode)op;
+      request->has_query = num_fields == 7;
+      return num_fields != 1 && (num_fields != 7 || parse_list_query(&fields[1], &request->query));
+
+    case OP_CREATE:
+      if (num_fields != 4 || parse_size(fields[1], &event_id) || parse_size(fields[2], &request->num_rows) ||
+          parse_size(fields[3], &request->num_cols)) {
+        return 1;
+      }
+      break;
+
+    case OP_RESERVE:
+      if (num_fields != 5 || parse_size(fields[1], &event_id) || parse_size(fields[2], &request->num_seats) ||
+          request->num_seats == 0 || request->num_seats > MAX_RESERVATION_SIZE ||
+          parse_coords(fields[3], request->xs, request->num_seats) ||
+          parse_coords(fields[4], request->ys, request->num_seats)) {
+        return 1;
+      }
+      break;
+
+    case OP_RESERVE_MULTI:
+      if (num_fields != 6 || parse_size(fields[1], &event_id) || parse_size(fields[2], &request->num_groups) ||
+          request->num_groups == 0 || request->num_groups > MAX_RESERVATION_GROUPS ||
+          parse_coords(fields[3], request->group_sizes, request->num_groups)) {
+        return 1;
+      }
+
+      request->num_seats = 0;
+      for (size_t g = 0; g < request->num_groups; g++) {
+        if (request->group_sizes[g] == 0 || request->group_sizes[g] > MAX_RESERVATION_SIZE - request->num_seats) {
+          return 1;
+        }
+        request->num_seats += request->group_sizes[g];
+      }
+
+      if (parse_coords(fields[4], request->xs, request->num_seats) ||
+          parse_coords(fields[5], request->ys, request->num_seats)) {
+        return 1;
+      }
+      break;
+
+    case OP_RESERVE_RANGES:
+      if (num_fields != 5 || parse_size(fields[1], &event_id) || parse_size(fields[2], &request->num_ranges) ||
+          request->num_ranges == 0 || request->num_ranges > MAX_RESERVATION_SIZE ||
+          parse_spans(fields[3], request->ranges, request->num_ranges, 1) ||
+          parse_spans(fields[4], request->ranges, request->num_ranges, 0)) {
+        return 1;
+      }
+      break;
+
+    case OP_SHOW:
+    case OP_STATS:
+      if (num_fields != 2 || parse_size(fields[1], &event_id)) {
+        return 1;
+      }
+      break;
+
+    case OP_DELETE: {
+      size_t archive;
+      if (num_fields != 3 || parse_size(fields[1], &event_id) || parse_size(fields[2], &archive) || archive > 1) {
+        return 1;
+      }
+      request->archive = (int)archive;
+      break;
+    }
+
+    default:
+      return 1;
+  }
+
+  if (event_id > UINT_MAX) {
+    return 1;
+  }
+
+  request->op = (enum OpCode)op;
+  request->event_id = (unsigned int)event_id;
+  return 0;
+}
+
+int request_event(const struct Request* request, unsigned int* event_id) {
+  switch (request->op) {
+    case OP_CREATE:
+    case OP_RESERVE:
+    case OP_RESERVE_MULTI:
+    case OP_RESERVE_RANGES:
+    case OP_SHOW:
+    case OP_STATS:
+    case OP_DELETE:
+      *event_id = request->event_id;
+      return 1;
+
+    case OP_SETUP:
+    case OP_QUIT:
+    case OP_LIST:
+    default:
+      return 0;
+  }
+}
+
+int execute_request(const struct Request* request, struct Buffer* reply, struct ReplyStream* stream) {
+  struct Buffer payload;
+  buffer_init(&payload);
+  int ret = 1;
+
+  switch (request->op) {
+    case OP_CREATE:
+      ret = ems_create(request->event_id, request->num_rows, request->num_cols);
+      break;
+
+    case OP_RESERVE:
+      // ems_reserve does not modify the coordinates
+      ret = ems_reserve(request->event_id, request->num_seats, (size_t*)request->xs, (size_t*)request->ys);
+      break;
+
+    case OP_RESERVE_RANGES:
+      ret = ems_reserve_ranges(request->event_id, request->num_ranges, request->ranges);
+      break;
+
+    case OP_RESERVE_MULTI: {
+      int results[MAX_RESERVATION_GROUPS];
+      ret = ems_reserve_multi(request->event_id, request->num_groups, request->group_sizes, request->xs, request->ys,
+                              results) ||
+            buffer_append(&payload, results, request->num_groups * sizeof(int));
+      break;
+    }
+
+    case OP_SHOW:
+      ret = ems_show(request->event_id, &stream->lines, &stream->cols, &stream->seats);
+      if (ret == 0) {
+        stream->op = OP_SHOW;
+        stream->end = stream->lines * stream->cols;
+      }
+      break;
+
+    case OP_STATS:
+      ret = ems_stats(&payload, request->event_id);
+      break;
+
+    case OP_DELETE:
+      ret = ems_delete(request->event_id, request->archive);
+      break;
+
+    case OP_LIST:
+      if (request->has_query) {
+        // A page is small enough to be sent at once
+        size_t listed;
+        ret = ems_query_events(&payload, &request->query, &listed);
+        if (ret == 0 && listed == 0) {
+          ret = buffer_print_str(&payload, "No events\n");
+        }
+        break;
+      }
+
+      ret = ems_list_events(&stream->lines, &stream->end);
+      if (ret == 0 && stream->lines == 0) {
+        ret = buffer_print_str(&payload, "No events\n");
+      } else if (ret == 0) {
+        stream->op = OP_LIST;
+      }
+      break;
+
+    case OP_SETUP:
+    case OP_QUIT:
+    default:
+      break;
+  }
+
+  // A failed operation never sends a partial payload
+  if (ret != 0) {
+    payload.len = 0;
+  }
+
+  char header[TAMMSG];
+  if (stream->op != 0) {
+    stream->position = 0;
+    stream->unsent = stream->lines;
+    stream->pending = 1;
+    format_stream_header(header, ret, stream->lines);
+  } else {
+    format_reply_header(header, ret, payload.len);
+  }
+  int failed = buffer_append(reply, header, TAMMSG) || buffer_append(reply, payload.data, payload.len);
+
+  buffer_free(&payload);
+  return failed;
+}
+
+void stream_init(struct ReplyStream* stream) {
+  stream->op = 0;
+  stream->pending = 0;
+  stream->seats = NULL;
+}
+
+int stream_next(struct ReplyStream* stream, struct Buffer* reply) {
+  size_t start = reply->len;
+  uint32_t size = 0;
+  if (buffer_append(reply, &size, sizeof(size))) {
+    return 1;
+  }
+
+  int ret =
+      stream->op == OP_LIST
+          ? ems_print_events(reply, &stream->position, stream->end, &stream->unsent, STREAM_CHUNK_SIZE)
+          : ems_print_seats(reply, stream->seats, stream->cols, &stream->position, stream->end, STREAM_CHUNK_SIZE);
+  if (ret != 0) {
+    return 1;
+  }
+
+  size = (uint32_t)(reply->len - start - sizeof(size));
+  memcpy(reply->data + start, &size, sizeof(size));
+
+  // Once every line has been printed, the chunk comes out empty and ends the stream
+  if (size == 0) {
+    stream_free(stream);
+  }
+  return 0;
+}
+
+void stream_free(struct ReplyStream* stream) {
+  free(stream->seats);
+  stream_init(stream);
+}
+
+/// Multiplies two sizes, saturating at SIZE_MAX instead of wrapping.
+static size_t saturating_product(size_t a, size_t b) { return b != 0 && a > SIZE_MAX / b ? SIZE_MAX : a * b; }
+
+size_t request_cost(const struct Request* request) {
+  size_t seats = 0;
+
+  switch (request->op) {
+    case OP_CREATE:
+      // Sizes are only validated once the request runs, so a huge CREATE must not wrap into a cheap one
+      seats = saturating_product(request->num_rows, request->num_cols);
+      break;
+    case OP_RESERVE:
+    case OP_RESERVE_MULTI:
+      seats = request->num_seats;
+      break;
+    case OP_RESERVE_RANGES:
+      for (size_t i = 0; i < request->num_ranges; i++) {
+        const struct SeatRange* range = &request->ranges[i];
+        if (range->last_row >= range->first_row && range->last_col >= range->first_col) {
+          size_t range_seats =
+              saturating_product(range->last_row - range->first_row + 1, range->last_col - range->first_col + 1);
+          seats = range_seats < SIZE_MAX - seats ? seats + range_seats : SIZE_MAX;
+        }
+      }
+      break;
+    case OP_SHOW:
+      seats = ems_event_seats(request->event_id);
+      break;
+    case OP_SETUP:
+    case OP_QUIT:
+    case OP_LIST:
+    case OP_STATS:
+    case OP_DELETE:
+    default:
+      break;
+  }
+
+  return seats / REQUEST_COST_SEATS < REQUEST_COST_MAX ? 1 + seats / REQUEST_COST_SEATS : REQUEST_COST_MAX;
+}
+
+enum StatsOp request_stats_op(const struct Request* request) {
+  switch (request->op) {
+    case OP_SETUP:
+      return STATS_OP_SETUP;
+    case OP_QUIT:
+      return STATS_OP_QUIT;
+    case OP_CREATE:
+      return STATS_OP_CREATE;
+    case OP_RESERVE:
+    case OP_RESERVE_RANGES:
+      return STATS_OP_RESERVE;
+    case OP_RESERVE_MULTI:
+      return STATS_OP_RESERVE_MULTI;
+    case OP_SHOW:
+      return STATS_OP_SHOW;
+    case OP_LIST:
+      return STATS_OP_LIST;
+    case OP_STATS:
+      return STATS_OP_STATS;
+    case OP_DELETE:
+      return STATS_OP_DELETE;
+    default:
+      return STATS_OP_COUNT;
+  }
+}
+
+int dispatch_request(char msg[TAMMSG], struct Buffer* reply, struct ReplyStream* stream, enum StatsOp* stats_op) {
+  struct Request request;
+  if (parse_request(msg, &request) != 0) {
+    char header[TAMMSG];
+    format_reply_header(header, 1, 0);
+    *stats_op = STATS_OP_COUNT;
+    return buffer_append(reply, header, TAMMSG);
+  }
+
+  *stats_op = request_stats_op(&request);
+  if (request.op == OP_QUIT) {
+    return 0;
+  }
+
+  return execute_request(&request, reply, stream);
+}
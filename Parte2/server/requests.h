@@ -0,0 +1,135 @@
+#ifndef SERVER_REQUESTS_H
+#define SERVER_REQUESTS_H
+
+#include <limits.h>
+#include <stddef.h>
+
+#include "buffer.h"
+#include "common/constants.h"
+#include "common/protocol.h"
+#include "stats.h"
+
+/// A LIST or SHOW reply, sent as a stream of chunks after its header.
+/// @note The chunks are printed from a snapshot taken by execute_request, so no lock is held between them and the
+/// memory used does not grow with the size of the reply.
+struct ReplyStream {
+  enum OpCode op;
+  int pending;          /// Whether chunks are left to append, including the empty one that ends the stream.
+  size_t lines;         /// Lines of the reply: events of LIST when it started, rows of SHOW.
+  size_t unsent;        /// Lines of LIST left to print, so that slots reused after it started never exceed lines.
+  size_t position;      /// Next slot of LIST, next seat of SHOW.
+  size_t end;           /// Number of slots of LIST, of seats of SHOW.
+  size_t cols;          /// Columns of the event of SHOW.
+  unsigned int* seats;  /// Seats of the event of SHOW, owned by the stream.
+};
+
+/// A parsed client request.
+struct Request {
+  enum OpCode op;
+
+  unsigned int event_id;  /// Event of CREATE, RESERVE, RESERVE_MULTI, RESERVE_RANGES, SHOW, STATS and DELETE.
+  size_t num_rows;        /// Number of rows of CREATE.
+  size_t num_cols;        /// Number of columns of CREATE.
+
+  size_t num_seats;                  /// Number of seats of RESERVE, in all the groups of RESERVE_MULTI.
+  size_t xs[MAX_RESERVATION_SIZE];   /// Rows of the seats of RESERVE and RESERVE_MULTI.
+  size_t ys[MAX_RESERVATION_SIZE];   /// Columns of the seats of RESERVE and RESERVE_MULTI.
+
+  size_t num_groups;                          /// Number of reservations of RESERVE_MULTI.
+  size_t group_sizes[MAX_RESERVATION_GROUPS];  /// Number of seats of each reservation of RESERVE_MULTI.
+
+  size_t num_ranges;                               /// Number of ranges of RESERVE_RANGES.
+  struct SeatRange ranges[MAX_RESERVATION_SIZE];  /// Blocks of seats of RESERVE_RANGES.
+
+  int has_query;           /// Whether a LIST asks for a page instead of every event.
+  struct ListQuery query;  /// Page and filters of LIST.
+
+  int archive;  /// Whether DELETE archives the event.
+};
+
+/// Parses a SETUP request.
+/// @param msg Request received on the server pipe, modified in place.
+/// @param req_pipe_path Buffer to store the path of the client's request pipe in.
+/// @param resp_pipe_path Buffer to store the path of the client's response pipe in.
+/// @param session_class Pointer to store the class requested by the client in, SESSION_CLASS_NORMAL if it has none.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_setup(char msg[TAMMSG], char req_pipe_path[PATH_MAX], char resp_pipe_path[PATH_MAX],
+                enum SessionClass* session_class);
+
+/// Opens the pipes of a new session and sends it its id.
+/// @note The response pipe, which the client opens before sending SETUP, is never waited for. Unless nonblocking is
+/// set, the request pipe is opened once the client opens its side.
+/// @param session_id Id of the session.
+/// @param req_pipe_path Path of the client's request pipe.
+/// @param resp_pipe_path Path of the client's response pipe.
+/// @param req_fd Pointer to store the file descriptor of the request pipe in.
+/// @param resp_fd Pointer to store the file descriptor of the response pipe in.
+/// @param nonblocking Whether both pipes are left non-blocking, for a server that polls them instead of waiting.
+/// @return 0 if the session was connected successfully, 1 otherwise.
+int connect_session(int session_id, const char* req_pipe_path, const char* resp_pipe_path, int* req_fd, int* resp_fd,
+                    int nonblocking);
+
+/// Refuses a SETUP because the server has no room for the session, answering SESSION_BUSY.
+/// @note Never blocks: the client opens its response pipe before sending SETUP, so the refusal is dropped if it is
+/// not open anymore. The request pipe is never opened.
+/// @param resp_pipe_path Path of the client's response pipe.
+/// @param retry_after_ms Suggested wait before the client tries again, in milliseconds.
+void reject_session(const char* resp_pipe_path, int retry_after_ms);
+
+/// Parses a request received on a session's request pipe.
+/// @param msg Request to parse, modified in place.
+/// @param request Request to store the parsed fields in.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_request(char msg[TAMMSG], struct Request* request);
+
+/// Gets the event a request has to look up in the state.
+/// @param request Request to check.
+/// @param event_id Pointer to store the id of the event in.
+/// @return 1 if the request looks up an event, 0 otherwise.
+int request_event(const struct Request* request, unsigned int* event_id);
+
+/// Executes a request and builds its reply: a TAMMSG header followed by the payload.
+/// @note The reply of a LIST or SHOW that succeeded is only the header of a stream, whose chunks are then appended by
+/// stream_next while stream->pending.
+/// @param request Request to execute.
+/// @param reply Empty buffer to store the reply in.
+/// @param stream Stream initialized by stream_init, to be released with stream_free.
+/// @return 0 if the reply was built successfully, 1 otherwise.
+int execute_request(const struct Request* request, struct Buffer* reply, struct ReplyStream* stream);
+
+/// Initializes a stream with no chunks pending.
+/// @param stream Stream to initialize.
+void stream_init(struct ReplyStream* stream);
+
+/// Appends the next chunk of a streamed reply, of about STREAM_CHUNK_SIZE bytes.
+/// @note Once the empty chunk that ends the stream has been appended, the stream is released.
+/// @param stream Stream with chunks pending.
+/// @param reply Buffer to append the chunk to.
+/// @return 0 if the chunk was appended successfully, 1 otherwise.
+int stream_next(struct ReplyStream* stream, struct Buffer* reply);
+
+/// Releases the snapshot of a stream, leaving no chunks pending.
+/// @param stream Stream to release.
+void stream_free(struct ReplyStream* stream);
+
+/// Estimates the work of a request, for the fair scheduling of the async server.
+/// @note One unit per request plus one per REQUEST_COST_SEATS seats it creates, reserves or shows.
+/// @param request Request to estimate.
+/// @return Cost of the request, at least 1.
+size_t request_cost(const struct Request* request);
+
+/// Gets the statistics bucket of a request.
+/// @param request Request to classify.
+/// @return The operation, STATS_OP_COUNT if it is not tracked.
+enum StatsOp request_stats_op(const struct Request* request);
+
+/// Parses and executes a request received on a session's request pipe, as a session worker does.
+/// @note An invalid request gets a bare error header; QUIT gets no reply at all.
+/// @param msg Request to dispatch, modified in place.
+/// @param reply Empty buffer to store the reply in.
+/// @param stream Stream initialized by stream_init, for the chunks that follow the reply.
+/// @param stats_op Pointer to store the statistics bucket of the request in, STATS_OP_QUIT for QUIT.
+/// @return 0 if the reply was built successfully, 1 otherwise.
+int dispatch_request(char msg[TAMMSG], struct Buffer* reply, struct ReplyStream* stream, enum StatsOp* stats_op);
+
+#endif  // SERVER_REQUESTS_H
@@ -0,0 +1,106 @@
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common/io.h"
+
+#define STATS_BUCKETS 48  // Bucket b holds latencies in [2^b, 2^(b+1)) microseconds
+
+struct OpStats {
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint64_t buckets[STATS_BUCKETS];
+};
+
+static const char* op_names[STATS_OP_COUNT] = {"SETUP", "QUIT",      "CREATE", "RESERVE", "SHOW",
+                                               "LIST",  "RES_MULTI", "STATS",  "DELETE",  "BUSY"};
+
+static struct OpStats op_stats[STATS_OP_COUNT];
+static uint64_t in_flight = 0;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+uint64_t stats_begin(void) {
+  pthread_mutex_lock(&stats_mutex);
+  in_flight++;
+  pthread_mutex_unlock(&stats_mutex);
+  return now_us();
+}
+
+void stats_end(enum StatsOp op, uint64_t start) {
+  uint64_t elapsed = now_us() - start;
+
+  size_t bucket = 0;
+  while (bucket < STATS_BUCKETS - 1 && (elapsed >> (bucket + 1)) != 0) {
+    bucket++;
+  }
+
+  pthread_mutex_lock(&stats_mutex);
+  in_flight--;
+  if (op >= STATS_OP_COUNT) {
+    pthread_mutex_unlock(&stats_mutex);
+    return;
+  }
+
+  struct OpStats* stats = &op_stats[op];
+  stats->count++;
+  stats->total_us += elapsed;
+  if (elapsed > stats->max_us) stats->max_us = elapsed;
+  stats->buckets[bucket]++;
+  pthread_mutex_unlock(&stats_mutex);
+}
+
+/// Estimates a latency percentile from the histogram.
+/// @note Returns the upper bound of the bucket the percentile falls in.
+/// @param stats Statistics of the operation.
+/// @param permille Percentile to estimate, in thousandths.
+/// @return Latency in microseconds.
+static uint64_t percentile(const struct OpStats* stats, uint64_t permille) {
+  uint64_t rank = (stats->count * permille + 999) / 1000;
+  uint64_t seen = 0;
+
+  for (size_t b = 0; b < STATS_BUCKETS; b++) {
+    seen += stats->buckets[b];
+    if (seen >= rank) {
+      uint64_t upper = (uint64_t)1 << (b + 1);
+      return upper < stats->max_us ? upper : stats->max_us;
+    }
+  }
+
+  return stats->max_us;
+}
+
+int stats_print(int out_fd) {
+  // Copy under the lock so that the (slow) writes do not block request threads
+  pthread_mutex_lock(&stats_mutex);
+  struct OpStats snapshot[STATS_OP_COUNT];
+  for (size_t op = 0; op < STATS_OP_COUNT; op++) snapshot[op] = op_stats[op];
+  uint64_t inflight = in_flight;
+  pthread_mutex_unlock(&stats_mutex);
+
+  char line[256];
+  snprintf(line, sizeof(line), "In-flight requests: %lu\n", (unsigned long)inflight);
+  if (print_str(out_fd, line)) return 1;
+
+  if (print_str(out_fd, "Latency (us):     count       avg       p50       p99      p999       max\n")) return 1;
+
+  for (size_t op = 0; op < STATS_OP_COUNT; op++) {
+    const struct OpStats* stats = &snapshot[op];
+    uint64_t avg = stats->count ? stats->total_us / stats->count : 0;
+
+    snprintf(line, sizeof(line), "  %-10s %10lu %9lu %9lu %9lu %9lu %9lu\n", op_names[op], (unsigned long)stats->count,
+             (unsigned long)avg, (unsigned long)percentile(stats, 500), (unsigned long)percentile(stats, 990),
+             (unsigned long)percentile(stats, 999), (unsigned long)stats->max_us);
+    if (print_str(out_fd, line)) return 1;
+  }
+
+  return 0;
+}
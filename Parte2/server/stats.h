@@ -0,0 +1,35 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <stdint.h>
+
+/// Operations tracked by the request statistics.
+enum StatsOp {
+  STATS_OP_SETUP,
+  STATS_OP_QUIT,
+  STATS_OP_CREATE,
+  STATS_OP_RESERVE,
+  STATS_OP_SHOW,
+  STATS_OP_LIST,
+  STATS_OP_RESERVE_MULTI,
+  STATS_OP_STATS,
+  STATS_OP_DELETE,
+  STATS_OP_BUSY,  // Requests and SETUPs refused because the server was overloaded
+  STATS_OP_COUNT  // Number of tracked operations
+};
+
+/// Marks the start of a request.
+/// @return Timestamp to be passed to stats_end.
+uint64_t stats_begin(void);
+
+/// Marks the end of a request and records its latency.
+/// @param op Operation that was served, STATS_OP_COUNT if it was not recognized.
+/// @param start Timestamp returned by stats_begin.
+void stats_end(enum StatsOp op, uint64_t start);
+
+/// Writes the request counters and latency percentiles.
+/// @param out_fd File descriptor to write to.
+/// @return 0 if the statistics were written successfully, 1 otherwise.
+int stats_print(int out_fd);
+
+#endif  // SERVER_STATS_H
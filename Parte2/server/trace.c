@@ -0,0 +1,132 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/protocol.h"
+
+#define TRACE_MAGIC "EMSTRC01"  // Format and version of the trace
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_FLUSH_US 1000000  // Longest time a record stays in the buffer
+
+static struct {
+  pthread_mutex_t mutex;
+  FILE* file;  // NULL when not recording
+  uint64_t opened_us;
+  uint64_t flushed_us;
+} trace = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+int trace_open(const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    perror("fopen - trace file");
+    return 1;
+  }
+
+  if (fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, file) != TRACE_MAGIC_SIZE || fflush(file) != 0) {
+    perror("fwrite - trace file");
+    fclose(file);
+    return 1;
+  }
+
+  pthread_mutex_lock(&trace.mutex);
+  trace.file = file;
+  trace.opened_us = now_us();
+  trace.flushed_us = trace.opened_us;
+  pthread_mutex_unlock(&trace.mutex);
+  return 0;
+}
+
+void trace_record(int session_id, const char msg[TAMMSG]) {
+  pthread_mutex_lock(&trace.mutex);
+  if (trace.file == NULL) {
+    pthread_mutex_unlock(&trace.mutex);
+    return;
+  }
+
+  uint64_t now = now_us();
+  uint64_t time_us = now - trace.opened_us;
+  int32_t session = session_id;
+  uint16_t len = (uint16_t)strnlen(msg, TAMMSG - 1);
+
+  if (fwrite(&time_us, sizeof(time_us), 1, trace.file) != 1 || fwrite(&session, sizeof(session), 1, trace.file) != 1 ||
+      fwrite(&len, sizeof(len), 1, trace.file) != 1 || fwrite(msg, 1, len, trace.file) != len) {
+    // A server must not stop serving because its trace cannot be written
+    perror("fwrite - trace file");
+    fclose(trace.file);
+    trace.file = NULL;
+  } else if (now - trace.flushed_us >= TRACE_FLUSH_US) {
+    fflush(trace.file);
+    trace.flushed_us = now;
+  }
+
+  pthread_mutex_unlock(&trace.mutex);
+}
+
+void trace_setup(int session_id, const char* req_pipe_path, const char* resp_pipe_path) {
+  char msg[TAMMSG];
+  snprintf(msg, sizeof(msg), "OP_CODE=%d|%s|%s", OP_SETUP, req_pipe_path, resp_pipe_path);
+  trace_record(session_id, msg);
+}
+
+void trace_flush(void) {
+  pthread_mutex_lock(&trace.mutex);
+  if (trace.file != NULL) {
+    fflush(trace.file);
+    trace.flushed_us = now_us();
+  }
+  pthread_mutex_unlock(&trace.mutex);
+}
+
+void trace_close(void) {
+  pthread_mutex_lock(&trace.mutex);
+  if (trace.file != NULL) {
+    fclose(trace.file);
+    trace.file = NULL;
+  }
+  pthread_mutex_unlock(&trace.mutex);
+}
+
+FILE* trace_reader_open(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    perror(path);
+    return NULL;
+  }
+
+  char magic[TRACE_MAGIC_SIZE];
+  if (fread(magic, 1, TRACE_MAGIC_SIZE, file) != TRACE_MAGIC_SIZE || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE)) {
+    fprintf(stderr, "%s is not a trace\n", path);
+    fclose(file);
+    return NULL;
+  }
+
+  return file;
+}
+
+int trace_read(FILE* file, struct TraceRecord* record) {
+  uint64_t time_us;
+  if (fread(&time_us, sizeof(time_us), 1, file) != 1) {
+    return feof(file) ? 1 : -1;
+  }
+
+  int32_t session;
+  uint16_t len;
+  if (fread(&session, sizeof(session), 1, file) != 1 || fread(&len, sizeof(len), 1, file) != 1 || len >= TAMMSG ||
+      fread(record->msg, 1, len, file) != len) {
+    return -1;
+  }
+
+  // The padding of the message was not recorded
+  memset(record->msg + len, 0, TAMMSG - len);
+  record->time_us = time_us;
+  record->session_id = session;
+  return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef SERVER_TRACE_H
+#define SERVER_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common/constants.h"
+
+/// A request read back from a trace.
+struct TraceRecord {
+  uint64_t time_us;  /// Time the request was received, since the trace was opened.
+  int session_id;    /// Session that sent the request.
+  char msg[TAMMSG];  /// Request as received, NUL-terminated.
+};
+
+/// Starts recording the requests received by the server.
+/// @note The trace is a TRACE_MAGIC header followed by one record per request: the time in microseconds (uint64_t),
+/// the session id (int32_t), the length of the request (uint16_t) and the request without its padding, all in host
+/// byte order. It is written through a buffer that is flushed when a session ends, on SIGUSR1 and at least every
+/// TRACE_FLUSH_US while requests keep arriving.
+/// @param path Path of the trace file, truncated if it exists.
+/// @return 0 if the trace was opened successfully, 1 otherwise.
+int trace_open(const char* path);
+
+/// Records a request, if a trace is open.
+/// @param session_id Session that sent the request.
+/// @param msg Request as received, before it is parsed.
+void trace_record(int session_id, const char msg[TAMMSG]);
+
+/// Records the SETUP of a session, if a trace is open.
+/// @param session_id Id given to the session.
+/// @param req_pipe_path Path of the client's request pipe.
+/// @param resp_pipe_path Path of the client's response pipe.
+void trace_setup(int session_id, const char* req_pipe_path, const char* resp_pipe_path);
+
+/// Writes the buffered records to the trace file.
+void trace_flush(void);
+
+/// Stops recording, flushing the buffered records.
+void trace_close(void);
+
+/// Opens a trace for reading.
+/// @param path Path of the trace file.
+/// @return The trace, positioned at the first record, NULL if it could not be opened or is not a trace.
+FILE* trace_reader_open(const char* path);
+
+/// Reads the next record of a trace.
+/// @param trace Trace returned by trace_reader_open.
+/// @param record Record to store the request in.
+/// @return 0 if a record was read, 1 at the end of the trace, -1 if the trace is truncated or corrupted.
+int trace_read(FILE* trace, struct TraceRecord* record);
+
+#endif  // SERVER_TRACE_H
@@ -0,0 +1,78 @@
+#!/bin/sh
+# Runs the client .jobs files of this directory against the sync and the async server and compares the output of each
+# one with the .out file next to it.
+# Each file of this directory gets a server of its own, so that LIST only sees its events. Events archived by
+# DELETE ARCHIVE are compared with archive/. The clients of concurrent/ share one server, with more of them than it
+# has sessions, so that the sync server refuses some as BUSY and the async one schedules them all at once.
+# Usage: tests/run.sh <server binary> <client binary>
+
+server=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+client=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+tests=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failed=0
+
+# Starts a server on $work/srv with the given flags, archiving deleted events in $work/archive
+start_server() {
+  rm -f "$work/srv"
+  "$server" "$@" -A "$work/archive" "$work/srv" 0 >"$work/server.log" 2>&1 &
+  server_pid=$!
+  while [ ! -p "$work/srv" ] && kill -0 "$server_pid" 2>/dev/null; do sleep 0.05; done
+}
+
+stop_server() {
+  kill "$server_pid"
+  wait "$server_pid" 2>/dev/null
+}
+
+# Compares the output of a .jobs file copied to $work with the expected one
+check() {
+  if ! diff -u "$1" "$2"; then
+    echo "FAIL: $(basename "$2") (ems $mode)"
+    failed=1
+  fi
+}
+
+for mode in "" "-a 2"; do
+  rm -rf "$work/archive"
+  mkdir "$work/archive"
+
+  for jobs in "$tests"/*.jobs; do
+    name=$(basename "$jobs" .jobs)
+    cp "$jobs" "$work/$name.jobs"
+    start_server $mode
+    timeout 60 "$client" "$work/req" "$work/resp" "$work/srv" "$work/$name.jobs" >/dev/null 2>&1
+    stop_server
+    check "$tests/$name.out" "$work/$name.out"
+  done
+
+  if ! diff -ru "$tests/archive" "$work/archive"; then
+    echo "FAIL: archive (ems $mode)"
+    failed=1
+  fi
+
+  start_server $mode
+  cp "$tests/concurrent/setup.jobs" "$work/setup.jobs"
+  timeout 60 "$client" "$work/req" "$work/resp" "$work/srv" "$work/setup.jobs" >/dev/null 2>&1
+  check "$tests/concurrent/setup.out" "$work/setup.out"
+
+  # A few clients ask for PRIORITY sessions, which the async server serves ahead of the NORMAL ones
+  pids=""
+  for k in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16; do
+    cp "$tests/concurrent/reads.jobs" "$work/reads$k.jobs"
+    class=""
+    [ $((k % 4)) -eq 0 ] && class="-p"
+    timeout 60 "$client" $class "$work/req$k" "$work/resp$k" "$work/srv" "$work/reads$k.jobs" >/dev/null 2>&1 &
+    pids="$pids $!"
+  done
+  wait $pids
+  stop_server
+  for k in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16; do
+    check "$tests/concurrent/reads.out" "$work/reads$k.out"
+  done
+done
+
+[ $failed -eq 0 ] && echo "All tests passed"
+exit $failed